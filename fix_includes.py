@@ -61,11 +61,18 @@ __author__ = 'csilvers@google.com (Craig Silverstein)'
 
 import difflib
 import argparse
+import multiprocessing
 import os
 import re
 import sys
+from collections import deque
 from collections import OrderedDict
 
+try:
+  from cStringIO import StringIO
+except ImportError:
+  from io import StringIO
+
 _EPILOG = """\
 Reads the output from include-what-you-use on stdin -- run with --v=1 (default)
 verbosity level or above -- and, unless --sort_only or --dry_run is specified,
@@ -245,6 +252,13 @@ class IWYUOutputRecord(object):
     # are removed before adding to this list.
     self.full_include_lines = OrderedDict()
 
+    # How many iwyu records were merged into this one, and where they
+    # disagreed: the line-numbers some but not all of them wanted to
+    # delete, and the lines some but not all of them wanted to add.
+    self.num_merged_records = 1
+    self.disputed_lines_to_delete = set()
+    self.disputed_lines_to_add = OrderedSet()
+
   def Merge(self, other):
     """Merges other with this one.  They must share a filename.
 
@@ -258,6 +272,17 @@ class IWYUOutputRecord(object):
         It must have the same value for filename that self does.
     """
     assert self.filename == other.filename, "Can't merge distinct files"
+    self.num_merged_records += other.num_merged_records
+    self.disputed_lines_to_delete.update(
+        self.lines_to_delete.symmetric_difference(other.lines_to_delete))
+    self.disputed_lines_to_delete.update(other.disputed_lines_to_delete)
+    self.disputed_lines_to_add.update(
+        self.includes_and_forward_declares_to_add.difference(
+            other.includes_and_forward_declares_to_add))
+    self.disputed_lines_to_add.update(
+        other.includes_and_forward_declares_to_add.difference(
+            self.includes_and_forward_declares_to_add))
+    self.disputed_lines_to_add.update(other.disputed_lines_to_add)
     self.lines_to_delete.intersection_update(other.lines_to_delete)
     self.some_include_lines.update(other.some_include_lines)
     self.seen_forward_declare_lines.update(other.seen_forward_declare_lines)
@@ -266,6 +291,24 @@ class IWYUOutputRecord(object):
         other.includes_and_forward_declares_to_add)
     self.full_include_lines.update(other.full_include_lines)
 
+  def DescribeConflicts(self):
+    """Returns a message saying where the merged records disagree, or None.
+
+    Merge resolves every disagreement conservatively, by keeping the line
+    in the file, so this is only informational.
+    """
+    if not self.disputed_lines_to_delete and not self.disputed_lines_to_add:
+      return None
+    message = ['(%s: the %d iwyu records for it disagree)'
+               % (self.filename, self.num_merged_records)]
+    if self.disputed_lines_to_delete:
+      message.append('  keeping lines only some want removed: %s'
+                     % ', '.join(str(line_number) for line_number
+                                 in sorted(self.disputed_lines_to_delete)))
+    for line in self.disputed_lines_to_add:
+      message.append('  adding line only some need: %s' % line)
+    return '\n'.join(message)
+
   def HasContentfulChanges(self):
     """Returns true iff this record has at least one add or delete."""
     return (self.includes_and_forward_declares_to_add or
@@ -2229,13 +2272,139 @@ def FixOneFile(iwyu_record, file_contents, flags, fileinfo):
   return old_lines, fixed_lines
 
 
+def _FixOneRecord(iwyu_record, flags):
+  """Calculate the fixes for the file listed in iwyu_record.
+
+  Returns:
+    A tuple (changed, fixed_lines, fileinfo).  changed tells if the file
+    needed fixing, fixed_lines is what should be written to it, or None if
+    nothing should be written (because it's unchanged or in dry_run mode).
+  """
+  fileinfo = FileInfo.parse(iwyu_record.filename)
+
+  file_contents = _ReadFile(iwyu_record.filename, fileinfo)
+  if not file_contents:
+    return False, None, None
+
+  print(">>> Fixing #includes in '%s'" % iwyu_record.filename)
+  old_lines, fixed_lines = FixOneFile(iwyu_record, file_contents, flags, fileinfo)
+  if old_lines == fixed_lines:
+    print("No changes in file %s" % iwyu_record.filename)
+    return False, None, None
+
+  if flags.dry_run:
+    PrintFileDiff(old_lines, fixed_lines)
+    return True, None, None
+
+  return True, fixed_lines, fileinfo
+
+
+def _FixOneRecordInWorker(iwyu_record, flags):
+  """Run _FixOneRecord in a worker process, capturing what it prints.
+
+  Returns the printed output followed by the _FixOneRecord result.
+  """
+  stdout = sys.stdout
+  sys.stdout = StringIO()
+  try:
+    try:
+      result = _FixOneRecord(iwyu_record, flags)
+    except FixIncludesError as why:
+      print('ERROR: %s - skipping file %s' % (why, iwyu_record.filename))
+      result = (False, None, None)
+    return (sys.stdout.getvalue(),) + result
+  finally:
+    sys.stdout = stdout
+
+
+def _CreateWorkerPool(jobs):
+  """Return a pool of jobs worker processes, externalized for testing."""
+  return multiprocessing.Pool(jobs)
+
+
+class ParallelFixer(object):
+  """Fixes files in a pool of worker processes as records are submitted.
+
+  Workers read the files and calculate the fixes, while writing them back is
+  left to the main process.  Everything is printed in submission order, so
+  the output doesn't depend on which worker finishes first.
+  """
+  def __init__(self, flags):
+    self.flags = flags
+    self.pool = _CreateWorkerPool(flags.jobs)
+    # Messages and (filename, pending result, keep_original) tuples, in
+    # submission order.
+    self.queue = deque()
+    self.fixed_files = set()
+    # (fileinfo, file lines) before writing, for files submitted with
+    # keep_original, keyed by filename.
+    self.original_contents = {}
+
+  def Print(self, message):
+    self.queue.append(message)
+    self._Flush(block=False)
+
+  def Submit(self, iwyu_record, keep_original=False):
+    """Fix the file listed in iwyu_record in a worker.
+
+    If keep_original is true, the contents the file had before it was
+    written are kept, so that RestoreOriginals can undo the fixes.
+    """
+    result = self.pool.apply_async(_FixOneRecordInWorker,
+                                   (iwyu_record, self.flags))
+    self.queue.append((iwyu_record.filename, result, keep_original))
+    self._Flush(block=False)
+
+  def RestoreOriginals(self, filenames):
+    """Wait for all submitted records, then undo the fixes to filenames."""
+    self._Flush(block=True)
+    for filename in filenames:
+      if filename in self.original_contents:
+        fileinfo, file_lines = self.original_contents.pop(filename)
+        _WriteFile(filename, fileinfo, file_lines)
+        self.fixed_files.discard(filename)
+
+  def Finish(self):
+    """Wait for all submitted records and return the number of files fixed."""
+    self._Flush(block=True)
+    self.pool.close()
+    self.pool.join()
+    print('IWYU edited %d files on your behalf.\n' % len(self.fixed_files))
+    return len(self.fixed_files)
+
+  def _Flush(self, block):
+    while self.queue:
+      item = self.queue[0]
+      if isinstance(item, tuple):
+        filename, result, keep_original = item
+        if not block and not result.ready():
+          return
+        output, changed, fixed_lines, fileinfo = result.get()
+        sys.stdout.write(output)
+        try:
+          if fixed_lines is not None:
+            if keep_original and filename not in self.original_contents:
+              file_lines = _ReadFile(filename, fileinfo)
+              if file_lines is not None:
+                self.original_contents[filename] = (fileinfo, file_lines)
+            _WriteFile(filename, fileinfo, fixed_lines)
+          if changed:
+            self.fixed_files.add(filename)
+        except FixIncludesError as why:
+          print('ERROR: %s - skipping file %s' % (why, filename))
+      else:
+        print(item)
+      self.queue.popleft()
+
+
 def FixManyFiles(iwyu_records, flags):
   """Given a list of iwyu_records, fix each file listed in the record.
 
   For each iwyu record in the input, which lists the #includes and
   forward-declares to add, remove, and re-sort, loads the file, makes
   the fixes, and writes the fixed file to disk.  The flags affect the
-  details of the fixing.
+  details of the fixing.  If flags.jobs is more than one, the files are
+  fixed in parallel.
 
   Arguments:
     iwyu_records: a collection of IWYUOutputRecord objects holding
@@ -2247,27 +2416,19 @@ def FixManyFiles(iwyu_records, flags):
   Returns:
     The number of files fixed (as opposed to ones that needed no fixing).
   """
+  if flags.jobs > 1:
+    fixer = ParallelFixer(flags)
+    for iwyu_record in iwyu_records:
+      fixer.Submit(iwyu_record)
+    return fixer.Finish()
+
   files_fixed = 0
   for iwyu_record in iwyu_records:
     try:
-      fileinfo = FileInfo.parse(iwyu_record.filename)
-
-      file_contents = _ReadFile(iwyu_record.filename, fileinfo)
-      if not file_contents:
-        continue
-
-      print(">>> Fixing #includes in '%s'" % iwyu_record.filename)
-      old_lines, fixed_lines = FixOneFile(iwyu_record, file_contents, flags, fileinfo)
-      if old_lines == fixed_lines:
-        print("No changes in file %s" % iwyu_record.filename)
-        continue
-
-      if flags.dry_run:
-        PrintFileDiff(old_lines, fixed_lines)
-      else:
+      changed, fixed_lines, fileinfo = _FixOneRecord(iwyu_record, flags)
+      if fixed_lines is not None:
         _WriteFile(iwyu_record.filename, fileinfo, fixed_lines)
-
-      files_fixed += 1
+      files_fixed += changed
     except FixIncludesError as why:
       print('ERROR: %s - skipping file %s' % (why, iwyu_record.filename))
 
@@ -2275,6 +2436,90 @@ def FixManyFiles(iwyu_records, flags):
   return files_fixed
 
 
+def _ParseIWYUOutputRecords(f, files_to_process, flags):
+  """Yield the IWYUOutputRecords in f for the files that should be fixed.
+
+  Records for files that should be skipped are replaced by a message
+  saying why.  See ProcessIWYUOutput for the arguments.
+  """
+  while True:
+    iwyu_output_parser = IWYUOutputParser()
+    try:
+      iwyu_record = iwyu_output_parser.ParseOneRecord(f, flags)
+      if not iwyu_record:
+        break
+    except FixIncludesError as why:
+      yield 'ERROR: %s' % why
+      continue
+    filename = NormalizeFilePath(flags.basedir, iwyu_record.filename)
+    if files_to_process is not None and filename not in files_to_process:
+      yield '(skipping %s: not listed on commandline)' % filename
+      continue
+    if flags.ignore_re and re.search(flags.ignore_re, filename):
+      yield '(skipping %s: it matches --ignore_re, which is %s)' % (
+          filename, flags.ignore_re)
+      continue
+    if flags.only_re and not re.search(flags.only_re, filename):
+      yield '(skipping %s: it does not match --only_re, which is %s)' % (
+          filename, flags.only_re)
+      continue
+
+    yield iwyu_record
+
+
+def _ProcessIWYUOutputInParallel(records, flags):
+  """Fix files in parallel as their records are parsed from IWYU output.
+
+  A source file is normally reported only by its own translation unit, so
+  it is dispatched to the workers as soon as its record is parsed.  A header
+  is reported by every translation unit that includes it, so its records
+  are merged, and it is dispatched once all the output has been read.
+
+  A source file can get more records too, when it is listed more than once
+  in a compilation database or reported via --check_also.  Those are merged
+  with the first one at the end, and the file is fixed again from its
+  original contents, so the result is the same as in the serial case.
+  """
+  fixer = ParallelFixer(flags)
+  # IWYUOutputRecords of the dispatched source files, keyed by filename.
+  dispatched = {}
+  # Merged IWYUOutputRecords of the other files, keyed by filename.
+  held_back = OrderedDict()
+
+  def Dispatch(iwyu_record, keep_original=False):
+    if flags.report_conflicts and iwyu_record.DescribeConflicts():
+      fixer.Print(iwyu_record.DescribeConflicts())
+    if (not flags.update_comments and
+        not iwyu_record.HasContentfulChanges()):
+      fixer.Print('(skipping %s: iwyu reports no contentful changes)' %
+                  iwyu_record.filename)
+    else:
+      fixer.Submit(iwyu_record, keep_original)
+
+  for iwyu_record in records:
+    if not isinstance(iwyu_record, IWYUOutputRecord):
+      fixer.Print(iwyu_record)
+      continue
+    filename = NormalizeFilePath(flags.basedir, iwyu_record.filename)
+    if filename in held_back:
+      held_back[filename].Merge(iwyu_record)
+    elif filename in dispatched or _MayBeHeaderFile(filename):
+      held_back[filename] = iwyu_record
+    else:
+      dispatched[filename] = iwyu_record
+      Dispatch(iwyu_record, keep_original=True)
+
+  fixer.RestoreOriginals([dispatched[filename].filename
+                          for filename in held_back
+                          if filename in dispatched])
+  for filename, iwyu_record in held_back.items():
+    if filename in dispatched:
+      dispatched[filename].Merge(iwyu_record)
+      iwyu_record = dispatched[filename]
+    Dispatch(iwyu_record)
+  return fixer.Finish()
+
+
 def ProcessIWYUOutput(f, files_to_process, flags, cwd):
   """Fix the #include and forward-declare lines as directed by f.
 
@@ -2299,37 +2544,30 @@ def ProcessIWYUOutput(f, files_to_process, flags, cwd):
     files_to_process = [NormalizeFilePath(cwd, fname)
                         for fname in files_to_process]
 
+  records = _ParseIWYUOutputRecords(f, files_to_process, flags)
+  if flags.jobs > 1:
+    return _ProcessIWYUOutputInParallel(records, flags)
+
   # First collect all the iwyu data from stdin.
 
   # Maintain sort order by using OrderedDict instead of dict
   iwyu_output_records = OrderedDict()  # IWYUOutputRecords keyed by filename
-  while True:
-    iwyu_output_parser = IWYUOutputParser()
-    try:
-      iwyu_record = iwyu_output_parser.ParseOneRecord(f, flags)
-      if not iwyu_record:
-        break
-    except FixIncludesError as why:
-      print('ERROR: %s' % why)
+  for iwyu_record in records:
+    if not isinstance(iwyu_record, IWYUOutputRecord):
+      print(iwyu_record)
       continue
     filename = NormalizeFilePath(flags.basedir, iwyu_record.filename)
-    if files_to_process is not None and filename not in files_to_process:
-      print('(skipping %s: not listed on commandline)' % filename)
-      continue
-    if flags.ignore_re and re.search(flags.ignore_re, filename):
-      print('(skipping %s: it matches --ignore_re, which is %s)' % (
-          filename, flags.ignore_re))
-      continue
-    if flags.only_re and not re.search(flags.only_re, filename):
-      print('(skipping %s: it does not match --only_re, which is %s)' % (
-          filename, flags.only_re))
-      continue
-
     if filename in iwyu_output_records:
       iwyu_output_records[filename].Merge(iwyu_record)
     else:
       iwyu_output_records[filename] = iwyu_record
 
+  if flags.report_conflicts:
+    for iwyu_record in iwyu_output_records.values():
+      conflicts = iwyu_record.DescribeConflicts()
+      if conflicts:
+        print(conflicts)
+
   # Now ignore all the files that never had any contentful changes
   # seen for them.  (We have to wait until we're all done, since a .h
   # file may have a contentful change when #included from one .cc
@@ -2467,6 +2705,20 @@ def main(argv):
                       default=False,
                       help='When sorting includes, place quoted ones first')
 
+  parser.add_argument('--report_conflicts', action='store_true', default=False,
+                      help=('When a file has several iwyu records, e.g. a'
+                            ' header seen from many source files, report'
+                            ' the lines they disagree about.  The edits are'
+                            ' merged conservatively either way: a line is'
+                            ' only removed if every record removes it, and'
+                            ' added if any record adds it.'))
+
+  parser.add_argument('-j', '--jobs', type=int, default=1,
+                      help=('Fix files using this many worker processes.'
+                            ' Source files are fixed while IWYU output is'
+                            ' still being read, headers once all of it has'
+                            ' been [default: 1]'))
+
   parser.add_argument('files', nargs='*', metavar='FILES')
 
   flags = parser.parse_args(argv[1:])
@@ -2484,6 +2736,9 @@ def main(argv):
   if flags.update_comments:
     flags.comments = True
 
+  if flags.jobs < 1:
+    sys.exit('FATAL ERROR: --jobs must be at least 1')
+
   exit_code = 0
   if flags.sort_only:
     if not files_to_modify:
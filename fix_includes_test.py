@@ -44,6 +44,8 @@ class FakeFlags(object):
     self.reorder = True
     self.basedir = None
     self.quoted_includes_first = False
+    self.report_conflicts = False
+    self.jobs = 1
 
 
 class FixIncludesBase(unittest.TestCase):
@@ -2173,6 +2175,81 @@ template <typename Arg1> ClassTemplate;
     self.RegisterFileContents({'twice.cc': infile})
     self.ProcessAndTest(iwyu_output)
 
+  def testReportConflicts(self):
+    """Test that --report_conflicts lists where merged records disagree."""
+    infile = """\
+// Copyright 2010
+
+#include <notused.h>
+///+#include <stdio.h>
+///+#include <string>  // for string
+#include "used.h"
+#include "used_in_a.h"
+"""
+    iwyu_output = """\
+conflict.h should add these lines:
+#include <stdio.h>
+
+conflict.h should remove these lines:
+- #include <notused.h>  // lines 3-3
+- #include "used_in_a.h"  // lines 5-5
+
+The full include-list for conflict.h:
+#include <stdio.h>
+#include "used.h"
+---
+
+conflict.h should add these lines:
+#include <stdio.h>
+#include <string>  // for string
+
+conflict.h should remove these lines:
+- #include <notused.h>  // lines 3-3
+
+The full include-list for conflict.h:
+#include <stdio.h>
+#include <string>  // for string
+#include "used.h"
+#include "used_in_a.h"  // lines 5-5
+---
+
+(conflict.h has correct #includes/fwd-decls)
+"""
+    self.flags.report_conflicts = True
+    self.RegisterFileContents({'conflict.h': infile})
+    self.ProcessAndTest(iwyu_output)
+    self.assertIn('(conflict.h: the 3 iwyu records for it disagree)\n'
+                  '  keeping lines only some want removed: 3, 5\n'
+                  '  adding line only some need: #include <string>\n'
+                  '  adding line only some need: #include <stdio.h>\n',
+                  self.stdout_stub.getvalue())
+
+  def testNoConflictsReportedWhenRecordsAgree(self):
+    """Test that --report_conflicts is quiet for identical records."""
+    infile = """\
+// Copyright 2010
+
+#include <notused.h>  ///-
+///+#include <stdio.h>
+#include "used.h"
+"""
+    record = """\
+agree.h should add these lines:
+#include <stdio.h>
+
+agree.h should remove these lines:
+- #include <notused.h>  // lines 3-3
+
+The full include-list for agree.h:
+#include <stdio.h>
+#include "used.h"
+---
+"""
+    self.flags.report_conflicts = True
+    self.RegisterFileContents({'agree.h': infile})
+    self.ProcessAndTest(record + '\n' + record)
+    self.assertNotIn('disagree', self.stdout_stub.getvalue())
+
   def testAddForwardDeclare(self):
     """Test adding a forward-declare, rather than keeping one."""
     infile = """\
@@ -4153,6 +4230,192 @@ The full include-list for dry_run:
     self.assertListEqual([], self.actual_after_contents)
     self.assertEqual(1, num_modified_files)
 
+  def testParallel(self):
+    """Tests that --jobs fixes source files first, merging header records."""
+    par_h = """\
+// Copyright 2010
+
+#include <notused.h>
+///+#include <stdio.h>
+#include "used.h"
+
+int Foo();
+"""
+    par_cc = """\
+// Copyright 2010
+
+#include <notused.h>  ///-
+#include "par.h"
+
+int Foo() { return 0; }
+"""
+    # par.h is reported by two translation units, and only one of them
+    # wants to remove <notused.h>, so it's kept.
+    iwyu_output = """\
+par.h should add these lines:
+#include <stdio.h>
+
+par.h should remove these lines:
+- #include <notused.h>  // lines 3-3
+
+The full include-list for par.h:
+#include <stdio.h>
+#include "used.h"
+---
+
+par.cc should add these lines:
+
+par.cc should remove these lines:
+- #include <notused.h>  // lines 3-3
+
+The full include-list for par.cc:
+#include "par.h"
+---
+
+par.h should add these lines:
+
+par.h should remove these lines:
+
+The full include-list for par.h:
+#include <notused.h>
+#include "used.h"
+---
+"""
+
+    self.flags.jobs = 2
+    self.RegisterFileContents({'par.h': par_h, 'par.cc': par_cc})
+    num_modified_files = self._ProcessInFakePool(iwyu_output)
+
+    self.assertListEqual(self.expected_after_map['par.cc'] +
+                         self.expected_after_map['par.h'],
+                         self.actual_after_contents)
+    self.assertEqual(2, num_modified_files)
+    self.assertEqual([">>> Fixing #includes in 'par.cc'",
+                      ">>> Fixing #includes in 'par.h'",
+                      'IWYU edited 2 files on your behalf.'],
+                     self.stdout_stub.getvalue().split('\n')[:3])
+
+  def testParallelMergesSourceFileRecords(self):
+    """Tests that --jobs merges repeated records for a source file too."""
+    infile = """\
+// Copyright 2010
+
+#include <notused.h>  ///-
+///+#include <stdio.h>
+#include "used.h"
+///+#include "used2.h"
+#include "used_only_in_config_a.h"
+"""
+    iwyu_output = """\
+twice.cc should add these lines:
+#include <stdio.h>
+
+twice.cc should remove these lines:
+- #include <notused.h>  // lines 3-3
+- #include "used_only_in_config_a.h"  // lines 5-5
+
+The full include-list for twice.cc:
+#include <stdio.h>
+#include "used.h"
+---
+
+twice.cc should add these lines:
+#include "used2.h"
+
+twice.cc should remove these lines:
+- #include <notused.h>  // lines 3-3
+
+The full include-list for twice.cc:
+#include "used.h"
+#include "used2.h"
+#include "used_only_in_config_a.h"
+---
+"""
+    self.RegisterFileContents({'twice.cc': infile})
+    self.ProcessAndTest(iwyu_output)
+    serial_after_contents = self.actual_after_contents
+
+    # twice.cc is fixed with the first record as soon as it's parsed, then
+    # restored and fixed again with both, so only the last write counts.
+    written_contents = {}
+    def WriteFile(filename, fileinfo, contents):
+      written_contents[filename] = contents
+    fix_includes._WriteFile = WriteFile
+    self.flags.jobs = 2
+    num_modified_files = self._ProcessInFakePool(iwyu_output)
+    self.assertListEqual(serial_after_contents, written_contents['twice.cc'])
+    self.assertEqual(1, num_modified_files)
+
+  def testParallelStreamsSourceFiles(self):
+    """Tests that --jobs dispatches source files before all output is read."""
+    self.RegisterFileContents({'stream.cc': '#include <notused.h>  ///-\n',
+                               'stream.h': '#include <notused.h>  ///-\n'})
+    events = []
+    def IwyuOutput():
+      for line in """\
+stream.cc should add these lines:
+
+stream.cc should remove these lines:
+- #include <notused.h>  // lines 1-1
+
+The full include-list for stream.cc:
+---
+
+stream.h should add these lines:
+
+stream.h should remove these lines:
+- #include <notused.h>  // lines 1-1
+
+The full include-list for stream.h:
+---
+""".splitlines(True):
+        yield line
+      events.append('EOF')
+
+    self.flags.jobs = 2
+    self._ProcessInFakePool(IwyuOutput(), events)
+    self.assertListEqual(['stream.cc', 'EOF', 'stream.h'], events)
+
+  def _ProcessInFakePool(self, iwyu_output, submitted_files=None):
+    """Runs ProcessIWYUOutput with a worker pool that runs in-process.
+
+    iwyu_output is a string or an iterable of lines.  The files submitted
+    to the pool are appended to submitted_files, if given.
+    """
+
+    class FakeResult(object):
+      """Never ready until waited for, to simulate slow workers."""
+      def __init__(self, func, args):
+        self.func, self.args = func, args
+
+      def ready(self):
+        return False
+
+      def get(self):
+        return self.func(*self.args)
+
+    class FakePool(object):
+      def apply_async(self, func, args):
+        if submitted_files is not None:
+          submitted_files.append(args[0].filename)
+        return FakeResult(func, args)
+
+      def close(self):
+        pass
+
+      def join(self):
+        pass
+
+    old_create_worker_pool = fix_includes._CreateWorkerPool
+    try:
+      fix_includes._CreateWorkerPool = lambda jobs: FakePool()
+      if isinstance(iwyu_output, str):
+        iwyu_output = StringIO(iwyu_output)
+      return fix_includes.ProcessIWYUOutput(
+          iwyu_output, None, self.flags, None)
+    finally:
+      fix_includes._CreateWorkerPool = old_create_worker_pool
+
   def testAddForwardDeclareAndKeepIwyuNamespaceFormat(self):
     """Tests that --keep_iwyu_namespace_format writes namespace lines
     using the IWYU one-line format.
@@ -88,12 +88,15 @@
 //     #include bar.h, unless it already does so.
 #include "iwyu.h"
 
+#include <algorithm>                    // for max, min
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>                      // for atoi, exit
 #include <map>                          // for map, swap, etc
 #include <memory>                       // for unique_ptr
 #include <set>                          // for set, set<>::iterator, swap
 #include <string>                       // for string, operator+, etc
+#include <system_error>                 // for error_code
 #include <utility>                      // for pair
 #include <vector>                       // for vector, swap
 
@@ -125,12 +128,16 @@
 #include "clang/Basic/Specifiers.h"
 #include "clang/Basic/BuiltinTraits.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendOptions.h"
 #include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Sema/Ownership.h"
 #include "clang/Sema/Sema.h"
 #include "iwyu_ast_util.h"
 #include "iwyu_cache.h"
+#include "iwyu_driver.h"
 #include "iwyu_globals.h"
+#include "iwyu_include_picker.h"
 #include "iwyu_location_util.h"
 #include "iwyu_output.h"
 #include "iwyu_port.h"  // for CHECK_
@@ -141,9 +148,16 @@
 #include "iwyu_verrs.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
 
 // TODO: Clean out pragmas as IWYU improves.
 // IWYU pragma: no_include "clang/AST/Redeclarable.h"
@@ -216,6 +230,8 @@ using clang::Expr;
 using clang::ExprResult;
 using clang::FriendDecl;
 using clang::FriendTemplateDecl;
+using clang::FrontendInputFile;
+using clang::FrontendOptions;
 using clang::FunctionDecl;
 using clang::FunctionProtoType;
 using clang::FunctionTemplateDecl;
@@ -294,6 +310,7 @@ using llvm::dyn_cast_or_null;
 using llvm::errs;
 using llvm::isa;
 using std::map;
+using std::pair;
 using std::set;
 using std::string;
 using std::swap;
@@ -316,6 +333,16 @@ bool CanIgnoreLocation(SourceLocation loc) {
           !ShouldReportIWYUViolationsFor(file_entry_after_macro_expansion));
 }
 
+// Returns the qualified name of decl, including any template arguments,
+// to name the time-trace scope of work done for it.
+string GetTimeTraceName(const NamedDecl* decl) {
+  string name;
+  llvm::raw_string_ostream ostream(name);
+  decl->getNameForDiagnostic(ostream, decl->getASTContext().getPrintingPolicy(),
+                             /*Qualified=*/true);
+  return name;
+}
+
 }  // anonymous namespace
 
 enum class DerefKind { None, RemoveRefs, RemoveRefsAndPtr };
@@ -955,15 +982,6 @@ class AstFlattenerVisitor : public BaseAstVisitor<AstFlattenerVisitor> {
       }
     }
 
-    void AddAll(const NodeSet& that) {
-      Extend(&typelocs, that.typelocs);
-      Extend(&nnslocs, that.nnslocs);
-      Extend(&tpl_names, that.tpl_names);
-      Extend(&tpl_args, that.tpl_args);
-      Extend(&tpl_arglocs, that.tpl_arglocs);
-      InsertAllInto(that.others, &others);
-    }
-
     // Needed since we're treated like an stl-like object.
     bool empty() const {
       return (typelocs.empty() && nnslocs.empty() &&
@@ -998,19 +1016,66 @@ class AstFlattenerVisitor : public BaseAstVisitor<AstFlattenerVisitor> {
     set<const void*> others;
   };
 
+  // The union of several NodeSets from the cache.  NodeSets are never
+  // changed or removed once cached, so this just refers to them, and is
+  // cheap to copy no matter how large the template patterns are.
+  class NodeSetUnion {
+   public:
+    template <typename T>
+    bool Contains(const T& node) const {
+      for (const NodeSet* node_set : node_sets_) {
+        if (node_set->Contains(node))
+          return true;
+      }
+      return false;
+    }
+
+    void Add(const NodeSet& node_set) {
+      if (!llvm::is_contained(node_sets_, &node_set))
+        node_sets_.push_back(&node_set);
+    }
+
+    void clear() {
+      node_sets_.clear();
+    }
+
+   private:
+    vector<const NodeSet*> node_sets_;
+  };
+
   //------------------------------------------------------------
   // Public interface:
 
   explicit AstFlattenerVisitor(CompilerInstance* compiler) : Base(compiler) { }
 
+  // Returns all the nodes below decl.  Every decl is only flattened
+  // once: the result is cached and stays valid for the whole TU.
   const NodeSet& GetNodesBelow(Decl* decl) {
     CHECK_(seen_nodes_.empty() && "Nodes should be clear before GetNodesBelow");
-    NodeSet* node_set = &nodeset_decl_cache_[decl];
-    if (node_set->empty()) {
-      TraverseDecl(decl);
-      swap(*node_set, seen_nodes_);  // move the seen_nodes_ into the cache
+    auto [it, inserted] = nodeset_decl_cache_.try_emplace(decl);
+    if (!inserted) {
+      ++num_cache_hits_;
+      return it->second;
     }
-    return *node_set;                // returns the cache entry
+    ++num_cache_misses_;
+    TraverseDecl(decl);
+    swap(it->second, seen_nodes_);  // move the seen_nodes_ into the cache
+    return it->second;              // returns the cache entry
+  }
+
+  static void PrintCacheStatistics() {
+    errs() << "Flattened uninstantiated templates: " << num_cache_misses_
+           << ", reused: " << num_cache_hits_ << "\n";
+  }
+
+  static void ClearCache() {
+    nodeset_decl_cache_.clear();
+    num_cache_hits_ = 0;
+    num_cache_misses_ = 0;
+  }
+
+  static FlattenerCacheStatistics GetCacheStatistics() {
+    return {nodeset_decl_cache_.size(), num_cache_hits_, num_cache_misses_};
   }
 
   //------------------------------------------------------------
@@ -1107,10 +1172,14 @@ class AstFlattenerVisitor : public BaseAstVisitor<AstFlattenerVisitor> {
   // need to make this map static.
   // TODO(csilvers): just have one flattener, so this needn't be static.
   static map<const Decl*, NodeSet> nodeset_decl_cache_;
+  static size_t num_cache_hits_;
+  static size_t num_cache_misses_;
 };
 
 map<const Decl*, AstFlattenerVisitor::NodeSet>
 AstFlattenerVisitor::nodeset_decl_cache_;
+size_t AstFlattenerVisitor::num_cache_hits_ = 0;
+size_t AstFlattenerVisitor::num_cache_misses_ = 0;
 
 // ----------------------------------------------------------------------
 // --- VisitorState
@@ -1137,6 +1206,78 @@ struct VisitorState {
   // instantiated calls, we can't store the exprs themselves, but have
   // to store their location.
   set<SourceLocation> processed_overload_locs;
+
+  // Memoized results of GetProvidedTypes, keyed by the type and the location
+  // of the typedef, alias or function declaration providing it.  Both
+  // visitors ask for the same typedefs over and over again.
+  map<pair<const Type*, SourceLocation>, set<const Type*>> provided_types;
+};
+
+// The types that are blocked (i.e. provided by someone else) while
+// ReportTypeUseInternal expands a type used through typedefs, aliases,
+// references, pointers and arrays.  Each level of that recursion only adds
+// a few types, so rather than copying the whole set at every step, a level
+// refers to its own additions and to the enclosing level.  Neither the set
+// nor the parent are owned, and both must outlive this object.
+class BlockedTypes {
+ public:
+  explicit BlockedTypes(const set<const Type*>* types,
+                        const BlockedTypes* parent = nullptr)
+      : types_(types), parent_(parent) {
+  }
+
+  bool Contains(const Type* type) const {
+    for (const BlockedTypes* level = this; level; level = level->parent_) {
+      if (level->types_ && ContainsKey(*level->types_, type))
+        return true;
+    }
+    return false;
+  }
+
+  void AddAllTo(set<const Type*>* types) const {
+    for (const BlockedTypes* level = this; level; level = level->parent_) {
+      if (level->types_)
+        InsertAllInto(*level->types_, types);
+    }
+  }
+
+ private:
+  const set<const Type*>* types_;
+  const BlockedTypes* parent_;
+};
+
+// An object of this type adds types to a blocked-type set, and removes
+// those that weren't there before in its destructor.  Unlike a ValueSaver,
+// it doesn't copy the whole set to restore it.
+class BlockedTypesAdder {
+ public:
+  explicit BlockedTypesAdder(set<const Type*>* blocked_types)
+      : blocked_types_(blocked_types) {
+  }
+  // Move constructor for factory methods.
+  BlockedTypesAdder(BlockedTypesAdder&& rhs)
+      : blocked_types_(rhs.blocked_types_), added_(std::move(rhs.added_)) {
+    rhs.blocked_types_ = nullptr;
+  }
+  BlockedTypesAdder(const BlockedTypesAdder&) = delete;
+
+  ~BlockedTypesAdder() {
+    if (blocked_types_) {
+      for (const Type* type : added_)
+        blocked_types_->erase(type);
+    }
+  }
+
+  void Add(const set<const Type*>& types) {
+    for (const Type* type : types) {
+      if (blocked_types_->insert(type).second)
+        added_.push_back(type);
+    }
+  }
+
+ private:
+  set<const Type*>* blocked_types_;
+  vector<const Type*> added_;
 };
 
 // ----------------------------------------------------------------------
@@ -1193,53 +1334,15 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
   //------------------------------------------------------------
   // IWYU logic.
 
-  // Helper for MapPrivateDeclToPublicDecl.  Returns true if the decl
-  // is a template specialization whose (written qualified) name matches
-  // the given name, has the given number of template arguments, and
-  // whose specified tpl argument is a type.
-  bool DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-      const Decl* decl, const string& name,
-      size_t num_args, size_t type_arg_idx) const {
-    const ClassTemplateSpecializationDecl* tpl_decl = DynCastFrom(decl);
-    if (!tpl_decl)
-      return false;
-    const string actual_name =
-        GetWrittenQualifiedNameAsString(tpl_decl, /*with_fn_args=*/false);
-    if (name != actual_name)
-      return false;
-    const TemplateArgumentList& tpl_args = tpl_decl->getTemplateArgs();
-    if (tpl_args.size() != num_args)
-      return false;
-    if (tpl_args.get(type_arg_idx).getKind() != TemplateArgument::Type)
-      return false;
-    return true;
-  }
-
-  // This requires the above function to have been called on decl, first.
-  const Type* GetTplTypeArg(const Decl* decl, size_t type_arg_idx) const {
-    const ClassTemplateSpecializationDecl* tpl_decl = DynCastFrom(decl);
-    CHECK_(tpl_decl && "Must call DeclIsTemplateWithNameAndNumArgsAndTypeArg");
-    const TemplateArgumentList& tpl_args = tpl_decl->getTemplateArgs();
-    CHECK_(tpl_args.size() > type_arg_idx && "Invalid type_arg_idx");
-    CHECK_(tpl_args.get(type_arg_idx).getKind() == TemplateArgument::Type);
-    return tpl_args.get(type_arg_idx).getAsType().getTypePtr();
-  }
-
   // Some types, such as __gnu_cxx::__normal_iterator or std::__wrap_iter, are
   // private types that should not be exposed to the user.  Instead, they're
   // exposed to the user via typedefs, like vector::iterator.
   // Sometimes, the typedef gets lost (such as for find(myvec.begin(),
-  // myvec.end(), foo)), so we need to manually map back.  We map
-  // __normal_iterator<foo, vector> to vector<> and __wrap_iter<foo> to foo,
-  // assuming that the vector<> class includes the typedef.  Likewise, we map
-  // any non-member function taking a private iterator (such as operator==) the
-  // same way, assuming that that (templatized) function is instantiated
-  // as part of the vector class.
-  //    We do something similar for _List_iterator and _List_const_iterator
-  // from GNU libstdc++, and for __list_iterator and __list_const_iterator
-  // from libc++.  These private names are defined in stl_list.h and list
-  // respectively, so we don't need to re-map them, but we do want to re-map
-  // reverse_iterator<_List_iterator> to something in list header.
+  // myvec.end(), foo)), so we need to manually map back, see
+  // PrivateWrapperTemplateCache.  Likewise, we map any non-member function
+  // taking a private iterator (such as operator==) the same way, assuming
+  // that that (templatized) function is instantiated as part of the vector
+  // class.
   //    If the input decl does not correspond to one of these private
   // decls, we return nullptr.  This method is actually a helper for
   // MapPrivateDeclToPublicDecl() and MapPrivateTypeToPublicType().
@@ -1259,40 +1362,7 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
       }
     }
 
-    // In addition to __normal_iterator<x> and __wrap_iter<x>, we want
-    // to handle reverse_iterator<__normal_iterator<x>>, and in the same way.
-    if (DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-            class_decl, "std::reverse_iterator", 1, 0)) {
-      const Type* reversed_iterator_type = GetTplTypeArg(class_decl, 0);
-      // Gets class_decl to be reversed iterator.
-      class_decl = TypeToDeclAsWritten(reversed_iterator_type);
-
-      // If it's reverse_iterator<_List_iterator>, map to
-      // _List_iterator, which is defined in stl_list like we want.  Also map
-      // reverse_iterator<__list_iterator> to __list_iterator which is defined
-      // in list.
-      if (DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-              class_decl, "std::_List_iterator", 1, 0) ||
-          DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-              class_decl, "std::_List_const_iterator", 1, 0) ||
-          DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-              class_decl, "std::__list_iterator", 2, 0) ||
-          DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-              class_decl, "std::__list_const_iterator", 2, 0)) {
-        return reversed_iterator_type;
-      }
-    }
-
-    if (DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-            class_decl, "__gnu_cxx::__normal_iterator", 2, 1)) {
-      return GetTplTypeArg(class_decl, 1);
-    }
-    if (DeclIsTemplateWithNameAndNumArgsAndTypeArg(
-            class_decl, "std::__wrap_iter", 1, 0)) {
-      return GetTplTypeArg(class_decl, 0);
-    }
-
-    return nullptr;
+    return GlobalPrivateWrapperTemplateCache()->GetPublicType(class_decl);
   }
 
   const NamedDecl* MapPrivateDeclToPublicDecl(const NamedDecl* decl) const {
@@ -1640,14 +1710,22 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
       ReportDeclUse(used_loc, decl);
   }
 
+  void ReportDeclsUse(SourceLocation used_loc,
+                      llvm::ArrayRef<const NamedDecl*> decls) {
+    for (const NamedDecl* decl : decls)
+      ReportDeclUse(used_loc, decl);
+  }
+
   // Called when the given type is fully used at used_loc, regardless
   // of the type being explicitly written in the source code or not.
   virtual void ReportTypeUse(SourceLocation used_loc, const Type* type,
                              DerefKind deref_kind) {
-    ReportTypeUseInternal(used_loc, type, blocked_types_, deref_kind);
+    ReportTypeUseInternal(used_loc, type, BlockedTypes(&blocked_types_),
+                          deref_kind);
   }
 
-  void ReportTypesUse(SourceLocation used_loc, const set<const Type*>& types) {
+  void ReportTypesUse(SourceLocation used_loc,
+                      llvm::ArrayRef<const Type*> types) {
     for (const Type* type : types)
       ReportTypeUse(used_loc, type, DerefKind::None);
   }
@@ -3449,8 +3527,15 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
     return visitor_state_->preprocessor_info;
   }
 
-  set<const Type*> GetProvidedTypes(const Type* type,
-                                    SourceLocation loc) const {
+  // The result is memoized in the visitor state, so the returned reference
+  // stays valid until the end of the translation unit.
+  const set<const Type*>& GetProvidedTypes(const Type* type,
+                                           SourceLocation loc) const {
+    const pair<const Type*, SourceLocation> key(type, loc);
+    if (const set<const Type*>* cached =
+            FindInMap(&visitor_state_->provided_types, key)) {
+      return *cached;
+    }
     set<const Type*> retval;
     for (const Type* component : GetComponentsOfTypeWithoutSubstituted(type)) {
       // TODO(csilvers): if one of the intermediate typedefs
@@ -3477,7 +3562,7 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
       if (!CodeAuthorWantsJustAForwardDeclare(canonical, loc))
         retval.insert(canonical);
     }
-    return retval;
+    return visitor_state_->provided_types[key] = std::move(retval);
   }
 
   set<const Type*> GetAliasTemplateProvidedTypes(
@@ -3491,11 +3576,11 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
   }
 
   template <typename... Sets>
-  ValueSaver<set<const Type*>> ScopedAdditionalBlockedTypes(
-      Sets&&... additional_blocked_types) {
-    set<const Type*> new_blocked_types =
-        Union(blocked_types_, std::forward<Sets>(additional_blocked_types)...);
-    return {&blocked_types_, new_blocked_types};
+  BlockedTypesAdder ScopedAdditionalBlockedTypes(
+      const Sets&... additional_blocked_types) {
+    BlockedTypesAdder blocked_types_adder(&blocked_types_);
+    (blocked_types_adder.Add(additional_blocked_types), ...);
+    return blocked_types_adder;
   }
 
   template <typename... Sets>
@@ -3580,7 +3665,7 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
   //   (void)s.t; // Full 'Class' type is needed due to template instantiation.
   // }
   void ReportTplSpecComponentTypes(
-      const Type*, const set<const Type*>& blocked_types) = delete;
+      const Type*, const BlockedTypes& blocked_types) = delete;
 
   // Figures out if the type is provided by template specialization argument
   // e.g. when being 'using Type = TemplateArgument;' referred to as
@@ -3599,12 +3684,14 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
       delete;
 
   void ReportTypeUseInternal(SourceLocation used_loc, const Type* type,
-                             set<const Type*> blocked_types,
+                             const BlockedTypes& outer_blocked_types,
                              DerefKind deref_kind) {
     // It is important not to lose info about type aliases while desugaring
     // and dereferencing here, because they are handled further.
     type = Desugar(type);
-    InsertAllInto(this->getDerived().GetProvidedByTplArg(type), &blocked_types);
+    const set<const Type*> provided_by_tpl_arg =
+        this->getDerived().GetProvidedByTplArg(type);
+    const BlockedTypes blocked_types(&provided_by_tpl_arg, &outer_blocked_types);
     if (deref_kind == DerefKind::RemoveRefs ||
         deref_kind == DerefKind::RemoveRefsAndPtr) {
       if (const auto* ref_type = dyn_cast_or_null<ReferenceType>(type)) {
@@ -3656,17 +3743,19 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
       if (!current_ast_node()->template ParentIsA<TypedefNameDecl>()) {
         const TypedefNameDecl* typedef_decl = typedef_type->getDecl();
         const Type* type = typedef_decl->getUnderlyingType().getTypePtr();
-        if (!IsStdNonProvidingTypedef(typedef_decl)) {
-          const set<const Type*>& provided_with_typedef =
-              GetProvidedTypes(type, GetLocation(typedef_decl));
-          InsertAllInto(provided_with_typedef, &blocked_types);
-        }
+        const set<const Type*>* provided_with_typedef = nullptr;
+        if (!IsStdNonProvidingTypedef(typedef_decl))
+          provided_with_typedef =
+              &GetProvidedTypes(type, GetLocation(typedef_decl));
         VERRS(6) << "User, not author, of typedef "
                  << typedef_decl->getQualifiedNameAsString()
                  << " owns the underlying type:\n";
         // If any of the used types are themselves typedefs, this will
         // result in a recursive expansion.
-        ReportTypeUseInternal(used_loc, type, blocked_types, deref_kind);
+        ReportTypeUseInternal(used_loc, type,
+                              BlockedTypes(provided_with_typedef,
+                                           &blocked_types),
+                              deref_kind);
       }
       return;
     }
@@ -3675,15 +3764,18 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
       if (template_spec_type->isTypeAlias()) {
         const Type* type = template_spec_type->getAliasedType().getTypePtr();
         const NamedDecl* decl = TypeToDeclAsWritten(template_spec_type);
+        set<const Type*> provided_with_alias;
         if (const auto* al_tpl_decl = dyn_cast<TypeAliasTemplateDecl>(decl)) {
-          InsertAllInto(
-              GetAliasTemplateProvidedTypes(template_spec_type, al_tpl_decl),
-              &blocked_types);
+          provided_with_alias =
+              GetAliasTemplateProvidedTypes(template_spec_type, al_tpl_decl);
         }
         // Builtin templates like __type_pack_element<0, Class*> are marked as
         // type alias substitutions, but have no associated alias template
         // decl, so report either way.
-        ReportTypeUseInternal(used_loc, type, blocked_types, deref_kind);
+        ReportTypeUseInternal(used_loc, type,
+                              BlockedTypes(&provided_with_alias,
+                                           &blocked_types),
+                              deref_kind);
         return;
       }
     }
@@ -3702,7 +3794,7 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
     // Don't place 'blocked_types' check before 'ReportTplSpecComponentTypes'
     // because template may be provided (i. e. blocked) but its arguments may be
     // not.
-    if (blocked_types.count(GetCanonicalType(type)))
+    if (blocked_types.Contains(GetCanonicalType(type)))
       return;
     if (const NamedDecl* decl = TypeToDeclAsWritten(type)) {
       if (!decl->getIdentifier()) {
@@ -3734,7 +3826,7 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
     if (IsPointerOrReferenceAsWritten(return_type))
       return;
 
-    ValueSaver<set<const Type*>> blocked_types_guard =
+    BlockedTypesAdder blocked_types_guard =
         ScopedAdditionalBlockedTypes(this->getDerived().GetProvidedByTplArg(
                                          callee, parent_type, calling_expr),
                                      GetProvidedTypesForFnReturn(callee));
@@ -3757,7 +3849,7 @@ class IwyuBaseAstVisitor : public BaseAstVisitor<Derived> {
     // iwyu requirement, in which case we're responsible for the
     // casted-to type.  See IwyuBaseASTVisitor::CanBeProvidedTypeComponent.
     const Type* type = expr->getType().getTypePtr();
-    ValueSaver<set<const Type*>> blocked_types_guard =
+    BlockedTypesAdder blocked_types_guard =
         ScopedAdditionalBlockedTypes(
             GetProvidedTypesForAutocast(current_ast_node()));
     ReportTypeUse(CurrentLoc(), type, DerefKind::None);
@@ -3855,6 +3947,9 @@ class InstantiatedTemplateVisitor
       const ASTNode* caller_ast_node,
       const map<const Type*, const Type*>& resugar_map,
       const set<const Type*>& blocked_types) {
+    llvm::TimeTraceScope trace_scope("IWYU ScanInstantiatedFunction", [&] {
+      return GetTimeTraceName(fn_decl);
+    });
     Clear();
     caller_ast_node_ = caller_ast_node;
     resugar_map_ = resugar_map;
@@ -3875,6 +3970,9 @@ class InstantiatedTemplateVisitor
       ASTNode* caller_ast_node,
       const map<const Type*, const Type*>& resugar_map,
       const set<const Type*>& blocked_types) {
+    llvm::TimeTraceScope trace_scope("IWYU ScanInstantiatedVariable", [&] {
+      return GetTimeTraceName(var_decl);
+    });
     Clear();
     caller_ast_node_ = caller_ast_node;
     resugar_map_ = resugar_map;
@@ -3895,6 +3993,9 @@ class InstantiatedTemplateVisitor
   void ScanInstantiatedType(ASTNode* caller_ast_node,
                             const map<const Type*, const Type*>& resugar_map,
                             const set<const Type*>& blocked_types) {
+    llvm::TimeTraceScope trace_scope("IWYU ScanInstantiatedType", [&] {
+      return PrintableType(caller_ast_node->GetAs<Type>());
+    });
     Clear();
     caller_ast_node_ = caller_ast_node;
     resugar_map_ = resugar_map;
@@ -3913,8 +4014,8 @@ class InstantiatedTemplateVisitor
     if (const NamedDecl* type_decl_as_written =
             GetDefinitionAsWritten(TypeToDeclAsWritten(type))) {
       AstFlattenerVisitor nodeset_getter(compiler());
-      nodes_to_ignore_ = nodeset_getter.GetNodesBelow(
-          const_cast<NamedDecl*>(type_decl_as_written));
+      nodes_to_ignore_.Add(nodeset_getter.GetNodesBelow(
+          const_cast<NamedDecl*>(type_decl_as_written)));
     }
 
     if (const auto* tpl_spec_type = type->getAs<TemplateSpecializationType>()) {
@@ -3937,8 +4038,8 @@ class InstantiatedTemplateVisitor
     set_current_ast_node(caller_ast_node);
 
     AstFlattenerVisitor nodeset_getter(compiler());
-    nodes_to_ignore_ = nodeset_getter.GetNodesBelow(
-        const_cast<NamedDecl*>(GetDefinitionAsWritten(decl)));
+    nodes_to_ignore_.Add(nodeset_getter.GetNodesBelow(
+        const_cast<NamedDecl*>(GetDefinitionAsWritten(decl))));
 
     TraverseDataAndTypeMembersOfClassHelper(decl);
   }
@@ -4438,7 +4539,7 @@ class InstantiatedTemplateVisitor
   // --- Handler declared in IwyuBaseASTVisitor.
 
   void ReportTplSpecComponentTypes(const Type* type,
-                                   const set<const Type*>& /*blocked_types*/) {
+                                   const BlockedTypes& /*blocked_types*/) {
     // TODO(bolshakov): should 'blocked_types' argument be considered here?
     TraverseDataAndTypeMembersOfClassHelper(type);
   }
@@ -4550,7 +4651,7 @@ class InstantiatedTemplateVisitor
     // the uninstantiated function, so we don't need to re-traverse
     // them here.
     AstFlattenerVisitor nodeset_getter(compiler());
-    ValueSaver<AstFlattenerVisitor::NodeSet> s(&nodes_to_ignore_);
+    ValueSaver<AstFlattenerVisitor::NodeSetUnion> s(&nodes_to_ignore_);
     // This gets to the decl for the (uninstantiated) template-as-written:
     const FunctionDecl* decl_as_written =
         fn_decl->getTemplateInstantiationPattern();
@@ -4565,7 +4666,7 @@ class InstantiatedTemplateVisitor
       if (const FunctionDecl* dfn = decl_as_written->getDefinition())
         decl_as_written = dfn;
       FunctionDecl* const daw = const_cast<FunctionDecl*>(decl_as_written);
-      nodes_to_ignore_.AddAll(nodeset_getter.GetNodesBelow(daw));
+      nodes_to_ignore_.Add(nodeset_getter.GetNodesBelow(daw));
     }
 
     // We need to iterate over the function.
@@ -4584,7 +4685,7 @@ class InstantiatedTemplateVisitor
     VarDecl* decl_as_written = decl->getTemplateInstantiationPattern();
     if (!decl_as_written)  // TODO(bolshakov): could it be null?
       return true;
-    nodes_to_ignore_.AddAll(
+    nodes_to_ignore_.Add(
         nodeset_getter.GetNodesBelow(decl_as_written->getDefinition()));
 
     // This is not TraverseDecl because clang otherwise skips
@@ -4653,6 +4754,9 @@ class InstantiatedTemplateVisitor
 
   bool TraverseDataAndTypeMembersOfClassHelper(
       const CXXRecordDecl* class_decl) {
+    llvm::TimeTraceScope trace_scope(
+        "IWYU TraverseDataAndTypeMembersOfClass",
+        [&] { return GetTimeTraceName(class_decl); });
     // If we have cached the reporting done for this decl before,
     // report again (but with the new caller_loc this time).
     // Otherwise, for all reporting done in the rest of this scope,
@@ -4734,7 +4838,7 @@ class InstantiatedTemplateVisitor
     // This says how the template-args are used by this hard-coded type
     // (a set<>, or map<>, or ...), to avoid having to recurse into them.
     const map<const Type*, const Type*>& resugar_map_for_precomputed_type =
-        FullUseCache::GetPrecomputedResugarMap(type, compiler()->getLangOpts());
+        GlobalFullUseTemplateCache()->GetResugarMap(type);
     // But we need to reconcile that with the types-of-interest, as
     // stored in resugar_map_.  To do this, we take only those entries
     // from resugar_map_for_precomputed_type that are also present in
@@ -4807,12 +4911,106 @@ class InstantiatedTemplateVisitor
   // Used to avoid recursion in the *Helper() methods.
   set<const Decl*> traversed_decls_;
 
-  AstFlattenerVisitor::NodeSet nodes_to_ignore_;
+  AstFlattenerVisitor::NodeSetUnion nodes_to_ignore_;
 
   // The current set of nodes we're updating cache entries for.
   set<CacheStoringScope*> cache_storers_;
 };  // class InstantiatedTemplateVisitor
 
+// ----------------------------------------------------------------------
+// --- Reporting
+// ----------------------------------------------------------------------
+//
+// A file inherits the desired includes of its associated headers, so
+// those must be calculated before the file itself.  Files that don't
+// depend on each other that way can be calculated concurrently (see
+// --jobs); their reports are buffered and printed in a fixed order, so
+// the output doesn't depend on the number of threads.
+
+// Returns the wave in which file_info can be calculated: one after the
+// last wave of its associated headers.
+static size_t GetCalculationWave(const IwyuFileInfo* file_info,
+                                 map<const IwyuFileInfo*, size_t>* waves) {
+  if (const size_t* wave = FindInMap(waves, file_info))
+    return *wave;
+  // Seed the entry so a cycle of associated headers terminates.
+  (*waves)[file_info] = 0;
+  size_t wave = 0;
+  for (const IwyuFileInfo* associated : file_info->associated_headers())
+    wave = std::max(wave, GetCalculationWave(associated, waves) + 1);
+  (*waves)[file_info] = wave;
+  return wave;
+}
+
+// Calculates iwyu violations for every file in file_infos, and returns
+// their reports in that order.
+static vector<IwyuFileResult> CalculateIwyuViolations(
+    const vector<IwyuFileInfo*>& file_infos) {
+  map<const IwyuFileInfo*, size_t> wave_of;
+  vector<vector<size_t>> waves;
+  for (size_t i = 0; i < file_infos.size(); ++i) {
+    const size_t wave = GetCalculationWave(file_infos[i], &wave_of);
+    if (wave >= waves.size())
+      waves.resize(wave + 1);
+    waves[wave].push_back(i);
+  }
+
+  vector<IwyuFileResult> results(file_infos.size());
+  // With --check_only, only the first file with violations is reported: the
+  // one with the lowest index in the first wave that has any, as on a single
+  // thread.  Files after it in that wave, and later waves, are skipped.
+  const bool check_only = GlobalFlags().check_only;
+  const size_t kNoViolations = file_infos.size();
+  std::atomic<size_t> first_violation(kNoViolations);
+  auto calculate = [&](size_t i) {
+    if (check_only && first_violation < i)
+      return;
+    results[i].num_edits =
+        file_infos[i]->CalculateAndReportIwyuViolations(&results[i].output);
+    if (results[i].num_edits == 0)
+      return;
+    size_t first = first_violation;
+    while (i < first && !first_violation.compare_exchange_weak(first, i)) {
+    }
+  };
+
+  // Debug output goes straight to errs(), so stay on one thread when
+  // there is any, or it would be interleaved.  The time-trace profiler
+  // only records scopes on the thread that started it, so stay on that
+  // one while profiling as well.
+  const size_t jobs = std::min<size_t>(GlobalFlags().jobs, file_infos.size());
+  if (jobs <= 1 || ShouldPrint(5) || llvm::timeTraceProfilerEnabled()) {
+    for (const vector<size_t>& wave : waves) {
+      for (size_t i : wave)
+        calculate(i);
+      if (check_only && first_violation != kNoViolations)
+        break;
+    }
+  } else {
+    SetSourceManagerIsShared(true);
+    llvm::DefaultThreadPool pool(llvm::hardware_concurrency(jobs));
+    for (const vector<size_t>& wave : waves) {
+      for (size_t i : wave)
+        pool.async([&calculate, i] { calculate(i); });
+      pool.wait();
+      if (check_only && first_violation != kNoViolations)
+        break;
+    }
+    SetSourceManagerIsShared(false);
+  }
+
+  // Files after the first violation that were already running report
+  // violations of their own; drop those.
+  if (check_only) {
+    for (size_t i = first_violation + 1; i < results.size(); ++i)
+      results[i] = IwyuFileResult();
+  }
+
+  for (size_t i = 0; i < file_infos.size(); ++i)
+    results[i].path = GetFilePath(file_infos[i]->file_entry());
+  return results;
+}
+
 // ----------------------------------------------------------------------
 // --- IwyuAstConsumer
 // ----------------------------------------------------------------------
@@ -4827,9 +5025,14 @@ class IwyuAstConsumer
  public:
   typedef IwyuBaseAstVisitor<IwyuAstConsumer> Base;
 
-  IwyuAstConsumer(VisitorState* visitor_state)
-      : Base(visitor_state),
-        instantiated_template_visitor_(visitor_state) {}
+  // If result is nullptr, HandleTranslationUnit prints the report and
+  // exits, otherwise it stores the result there.
+  IwyuAstConsumer(std::unique_ptr<VisitorState> visitor_state,
+                  IwyuResult* result)
+      : Base(visitor_state.get()),
+        instantiated_template_visitor_(visitor_state.get()),
+        owned_visitor_state_(std::move(visitor_state)),
+        result_(result) {}
 
   //------------------------------------------------------------
   // Implements pure virtual methods from Base.
@@ -4878,6 +5081,31 @@ class IwyuAstConsumer
   // Called once at the beginning of the compilation.
   void Initialize(ASTContext& context) override {}  // NOLINT
 
+  // Writes the paths of the main file and everything it includes,
+  // directly or indirectly, to filename, one per line.
+  void WriteDependencyFile(const string& filename) const {
+    std::error_code error;
+    llvm::raw_fd_ostream out(filename, error);
+    if (error) {
+      llvm::errs() << filename << ": " << error.message() << "\n";
+      return;
+    }
+    OptionalFileEntryRef main_file = preprocessor_info().main_file();
+    const set<OptionalFileEntryRef>* includes =
+        preprocessor_info().TransitiveIncludesOf(main_file);
+    if (includes == nullptr) {
+      out << GetFilePath(main_file) << "\n";
+    } else {
+      for (OptionalFileEntryRef file : *includes) {
+        if (file)
+          out << GetFilePath(file) << "\n";
+      }
+    }
+    // Editing a mapping file can change the analysis too.
+    for (const string& mapping_file : GlobalIncludePicker().GetMappingFiles())
+      out << mapping_file << "\n";
+  }
+
   // Called once at the end of the compilation.
   void HandleTranslationUnit(ASTContext& context) override {  // NOLINT
     // TODO(csilvers): automatically detect preprocessing is done, somehow.
@@ -4910,10 +5138,21 @@ class IwyuAstConsumer
     // Run IWYU analysis.
     TraverseDecl(tu_decl);
 
+    if (ShouldPrint(9))
+      AstFlattenerVisitor::PrintCacheStatistics();
+
+    // Written even if the translation unit has errors, so that whoever
+    // consumes it knows when to try again.
+    if (!GlobalFlags().dependency_file.empty())
+      WriteDependencyFile(GlobalFlags().dependency_file);
+
     // Check if any unrecoverable errors have occurred.
     // There is no point in continuing when the AST is in a bad state.
-    if (compiler()->getDiagnostics().hasUnrecoverableErrorOccurred())
+    if (compiler()->getDiagnostics().hasUnrecoverableErrorOccurred()) {
+      if (result_)
+        return;  // Leaves result_->success false.
       exit(EXIT_FAILURE);
+    }
 
     const set<OptionalFileEntryRef>* const files_to_report_iwyu_violations_for =
         preprocessor_info().files_to_report_iwyu_violations_for();
@@ -4927,32 +5166,48 @@ class IwyuAstConsumer
       preprocessor_info().FileInfoFor(file)->ResolvePendingAnalysis();
     }
 
-    // We have to calculate the .h files before the .cc file, since
-    // the .cc file inherits #includes from the .h files, and we
-    // need to figure out what those #includes are going to be.
-    size_t num_edits = 0;
+    // Report the .h files before the .cc file.  The calculation order
+    // is derived from the associated headers, independently of this.
+    vector<IwyuFileInfo*> file_infos;
     OptionalFileEntryRef const main_file = preprocessor_info().main_file();
     for (OptionalFileEntryRef file : *files_to_report_iwyu_violations_for) {
       if (file == main_file)
         continue;
       CHECK_(preprocessor_info().FileInfoFor(file));
-      num_edits += preprocessor_info().FileInfoFor(file)
-          ->CalculateAndReportIwyuViolations();
+      file_infos.push_back(preprocessor_info().FileInfoFor(file));
+    }
+    // With --standalone_header, the main file is the synthesized one (see
+    // IwyuAction::PrepareToExecuteAction), which isn't worth a report.
+    if (GlobalFlags().standalone_header.empty()) {
+      CHECK_(preprocessor_info().FileInfoFor(main_file));
+      file_infos.push_back(preprocessor_info().FileInfoFor(main_file));
     }
-    CHECK_(preprocessor_info().FileInfoFor(main_file));
-    num_edits += preprocessor_info().FileInfoFor(main_file)
-        ->CalculateAndReportIwyuViolations();
+    IwyuResult result;
+    result.files = CalculateIwyuViolations(file_infos);
+    for (const IwyuFileResult& file_result : result.files)
+      result.num_edits += file_result.num_edits;
 
-    int exit_code = EXIT_SUCCESS;
+    result.exit_code = EXIT_SUCCESS;
     if (GlobalFlags().exit_code_always) {
       // If we should always fail, use --error_always value.
-      exit_code = GlobalFlags().exit_code_always;
-    } else if (num_edits > 0) {
+      result.exit_code = GlobalFlags().exit_code_always;
+    } else if (result.num_edits > 0) {
       // If there were IWYU violations, use --error value.
-      exit_code = GlobalFlags().exit_code_error;
+      result.exit_code = GlobalFlags().exit_code_error;
+    }
+    result.success = true;
+
+    if (result_) {
+      *result_ = std::move(result);
+      return;
     }
 
-    exit(exit_code);
+    for (const IwyuFileResult& file_result : result.files)
+      errs() << file_result.output;
+
+    // We don't return to the driver, so write the time trace (if any) now.
+    WriteTimeTrace(compiler());
+    exit(result.exit_code);
   }
 
   void ParseFunctionTemplates(Sema& sema, TranslationUnitDecl* tu_decl) {
@@ -5805,11 +6060,11 @@ class IwyuAstConsumer
   // --- Handler declared in IwyuBaseASTVisitor.
 
   void ReportTplSpecComponentTypes(const Type* type,
-                                   const set<const Type*>& blocked_types) {
+                                   const BlockedTypes& blocked_types) {
     TemplateInstantiationData data = GetTplInstData(type);
     ASTNode node(type);
     node.SetParent(current_ast_node());
-    data.provided_types.insert(blocked_types.begin(), blocked_types.end());
+    blocked_types.AddAllTo(&data.provided_types);
     instantiated_template_visitor_.ScanInstantiatedType(&node, data.resugar_map,
                                                         data.provided_types);
   }
@@ -6050,10 +6305,52 @@ class IwyuAstConsumer
 
   // Class we call to handle instantiated template functions and classes.
   InstantiatedTemplateVisitor instantiated_template_visitor_;
+
+  // Shared by this visitor and instantiated_template_visitor_.
+  std::unique_ptr<VisitorState> owned_visitor_state_;
+
+  // Where to store the result, or nullptr to print it and exit.
+  IwyuResult* const result_;
 };  // class IwyuAstConsumer
 
 // IWYU frontend action impl.
-IwyuAction::IwyuAction(const ToolChain& toolchain) : toolchain_(toolchain) {
+IwyuAction::IwyuAction(const ToolChain& toolchain, IwyuResult* result)
+    : toolchain_(toolchain), result_(result) {
+}
+
+bool IwyuAction::PrepareToExecuteAction(CompilerInstance& compiler) {
+  const string& header = GlobalFlags().standalone_header;
+  if (header.empty())
+    return true;
+
+  // The source file on the command line only provides the compile flags for
+  // analyzing the header.  Swap it for a file next to the header that does
+  // nothing but #include it, so the header is its associated header (hence
+  // the test_headercompile_ name), and is analyzed on its own.
+  FrontendOptions& frontend_opts = compiler.getFrontendOpts();
+  if (frontend_opts.Inputs.size() != 1 || !frontend_opts.Inputs[0].isFile()) {
+    errs() << "error: --standalone_header needs exactly one source file "
+              "to take the compile flags from\n";
+    return false;
+  }
+  const FrontendInputFile& input = frontend_opts.Inputs[0];
+
+  llvm::SmallString<128> source_path(llvm::sys::path::parent_path(header));
+  llvm::sys::path::append(
+      source_path, "test_headercompile_" + llvm::sys::path::stem(header) +
+                       llvm::sys::path::extension(input.getFile()));
+  const string contents = "#include \"" +
+                          llvm::sys::path::filename(header).str() +
+                          "\"  // IWYU pragma: associated\n";
+  VERRS(4) << "Analyzing " << header << " in " << source_path << ":\n"
+           << contents;
+
+  compiler.getPreprocessorOpts().addRemappedFile(
+      source_path,
+      llvm::MemoryBuffer::getMemBufferCopy(contents, source_path).release());
+  frontend_opts.Inputs[0] =
+      FrontendInputFile(source_path, input.getKind(), input.isSystem());
+  return true;
 }
 
 std::unique_ptr<ASTConsumer> IwyuAction::CreateASTConsumer(
@@ -6061,6 +6358,9 @@ std::unique_ptr<ASTConsumer> IwyuAction::CreateASTConsumer(
   // Do this first thing after getting our hands on initialized
   // CompilerInstance and ToolChain objects.
   InitGlobals(compiler, toolchain_);
+  // This is keyed by AST nodes, which may be reused by another translation
+  // unit analyzed in-process.
+  AstFlattenerVisitor::ClearCache();
 
   Preprocessor& preprocessor = compiler.getPreprocessor();
   auto* const preprocessor_consumer = new IwyuPreprocessorInfo(preprocessor);
@@ -6068,9 +6368,22 @@ std::unique_ptr<ASTConsumer> IwyuAction::CreateASTConsumer(
       std::unique_ptr<PPCallbacks>(preprocessor_consumer));
   preprocessor.addCommentHandler(preprocessor_consumer);
 
-  auto* const visitor_state =
-      new VisitorState(&compiler, *preprocessor_consumer);
-  return std::unique_ptr<IwyuAstConsumer>(new IwyuAstConsumer(visitor_state));
+  auto visitor_state =
+      std::make_unique<VisitorState>(&compiler, *preprocessor_consumer);
+  return std::make_unique<IwyuAstConsumer>(std::move(visitor_state), result_);
+}
+
+IwyuResult RunIwyu(int argc, const char** argv, const CommandlineFlags& flags) {
+  SetGlobalFlags(flags);
+  IwyuResult result;
+  ExecuteAction(argc, argv, [&result](const ToolChain& toolchain) {
+    return std::make_unique<IwyuAction>(toolchain, &result);
+  });
+  return result;
+}
+
+FlattenerCacheStatistics GetFlattenerCacheStatisticsForTesting() {
+  return AstFlattenerVisitor::GetCacheStatistics();
 }
 
 } // namespace include_what_you_use
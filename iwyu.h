@@ -7,6 +7,14 @@
 //
 //===----------------------------------------------------------------------===//
 
+#ifndef INCLUDE_WHAT_YOU_USE_IWYU_H_
+#define INCLUDE_WHAT_YOU_USE_IWYU_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "clang/Frontend/FrontendAction.h"
 
 namespace clang {
@@ -23,12 +31,43 @@ using clang::CompilerInstance;
 using clang::driver::ToolChain;
 using llvm::StringRef;
 
+struct CommandlineFlags;
+
+// The iwyu report for one file of a translation unit.
+struct IwyuFileResult {
+  std::string path;
+  // Number of #includes and forward-declares to add or remove.
+  size_t num_edits = 0;
+  // The report, exactly as the iwyu binary would print it.
+  std::string output;
+};
+
+// The outcome of analyzing one translation unit.
+struct IwyuResult {
+  // False if the translation unit couldn't be analyzed, for instance
+  // because it doesn't compile.  The other fields are only meaningful
+  // when this is true.
+  bool success = false;
+  // The exit code the iwyu binary would have exited with.
+  int exit_code = 0;
+  size_t num_edits = 0;
+  // In the order the iwyu binary prints them: headers before the main file.
+  std::vector<IwyuFileResult> files;
+};
+
 // We use an ASTFrontendAction to hook up IWYU with Clang.
 class IwyuAction : public ASTFrontendAction {
  public:
-  explicit IwyuAction(const ToolChain& toolchain);
+  // If result is nullptr, the action prints its report and exits the
+  // process when the translation unit has been analyzed, like the iwyu
+  // binary does.  Otherwise, it stores the result there and returns.
+  explicit IwyuAction(const ToolChain& toolchain,
+                      IwyuResult* result = nullptr);
 
  protected:
+  // Sets up the synthesized source file for --standalone_header.
+  bool PrepareToExecuteAction(CompilerInstance& compiler) override;
+
   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& compiler,
                                                  StringRef) override;
 
@@ -36,6 +75,27 @@ class IwyuAction : public ASTFrontendAction {
   // ToolChain is not copyable, but it's owned by Compilation which has the same
   // lifetime as CompilerInstance, so it should be alive for as long as we are.
   const ToolChain& toolchain_;
+  IwyuResult* const result_;
+};
+
+// Runs IWYU in-process on the compilation described by the clang command
+// line in argc/argv, with the given IWYU flags (no -Xiwyu arguments are
+// parsed), and returns the result instead of printing it and exiting.
+// argv[0] is the path to locate clang's resource dir from, as for the iwyu
+// binary.  Each call re-initializes IWYU's global state, so calls must not
+// overlap, but any number of translation units can be analyzed one after
+// the other.  LLVM targets must have been initialized, as in iwyu_main.cc.
+IwyuResult RunIwyu(int argc, const char** argv, const CommandlineFlags& flags);
+
+// How the cache of flattened uninstantiated templates was used for the
+// translation unit analyzed last.  For tests.
+struct FlattenerCacheStatistics {
+  size_t num_cached_decls = 0;
+  size_t num_hits = 0;
+  size_t num_misses = 0;
 };
+FlattenerCacheStatistics GetFlattenerCacheStatisticsForTesting();
 
 }  // namespace include_what_you_use
+
+#endif  // INCLUDE_WHAT_YOU_USE_IWYU_H_
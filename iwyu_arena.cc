@@ -0,0 +1,26 @@
+//===--- iwyu_arena.cc - per-translation-unit memory for iwyu -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "iwyu_arena.h"
+
+#include "iwyu_location_util.h"
+
+namespace include_what_you_use {
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  ParallelCalculationLock lock(mutex_);
+  return allocator_.Allocate(size, llvm::Align(alignment));
+}
+
+size_t Arena::BytesAllocated() const {
+  ParallelCalculationLock lock(mutex_);
+  return allocator_.getBytesAllocated();
+}
+
+}  // namespace include_what_you_use
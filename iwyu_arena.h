@@ -0,0 +1,111 @@
+//===--- iwyu_arena.h - per-translation-unit memory for iwyu --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// The analysis of a translation unit makes many small allocations that all
+// live until the end of the translation unit: the uses and #include lines
+// reported against each file, and the cached full uses of instantiated
+// templates.  These are bump-allocated from an arena that is dropped as a
+// whole when the next translation unit starts (see InitGlobals), instead of
+// going through malloc and free one at a time.
+//
+// Nothing allocated from the arena may outlive its translation unit.
+// Memory is never given back to the arena before that, so a vector that
+// grows in it leaves its old buffers behind, like clang's ASTVector does.
+
+#ifndef INCLUDE_WHAT_YOU_USE_IWYU_ARENA_H_
+#define INCLUDE_WHAT_YOU_USE_IWYU_ARENA_H_
+
+#include <algorithm>                    // for copy
+#include <cstddef>                      // for size_t
+#include <mutex>                        // for mutex
+#include <type_traits>                  // for true_type
+#include <vector>                       // for vector
+
+#include "iwyu_globals.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Allocator.h"
+
+namespace include_what_you_use {
+
+class Arena {
+ public:
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Returns uninitialized memory for size bytes.  With --jobs, the
+  // iwyu violations of several files are calculated at once, so this
+  // locks while they are.
+  void* Allocate(size_t size, size_t alignment);
+
+  // Copies values into the arena.
+  template <typename T>
+  llvm::ArrayRef<T> Copy(llvm::ArrayRef<T> values) {
+    if (values.empty())
+      return llvm::ArrayRef<T>();
+    T* copy = static_cast<T*>(Allocate(values.size() * sizeof(T), alignof(T)));
+    std::copy(values.begin(), values.end(), copy);
+    return llvm::ArrayRef<T>(copy, values.size());
+  }
+
+  size_t BytesAllocated() const;
+
+ private:
+  mutable std::mutex mutex_;
+  llvm::BumpPtrAllocator allocator_;
+};
+
+// A standard allocator that allocates from an arena, by default the one of
+// the translation unit being analyzed.  Deallocation is a no-op: the memory
+// is reclaimed with the arena.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  ArenaAllocator() : arena_(GlobalArena()) {
+  }
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {
+  }
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other)  // NOLINT
+      : arena_(other.arena_) {
+  }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {
+  }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena_;
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.arena_;
+  }
+
+ private:
+  template <typename U>
+  friend class ArenaAllocator;
+
+  Arena* arena_;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace include_what_you_use
+
+#endif  // INCLUDE_WHAT_YOU_USE_IWYU_ARENA_H_
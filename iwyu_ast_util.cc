@@ -11,7 +11,7 @@
 
 #include "iwyu_ast_util.h"
 
-#include <regex>
+#include <map>                          // for map
 #include <set>                          // for set
 #include <string>                       // for string, operator+, etc
 #include <utility>                      // for pair
@@ -46,6 +46,7 @@
 #include "clang/Sema/Initialization.h"
 #include "clang/Sema/Ownership.h"
 #include "clang/Sema/Sema.h"
+#include "iwyu_cache.h"
 #include "iwyu_globals.h"
 #include "iwyu_location_util.h"
 #include "iwyu_path_util.h"
@@ -172,6 +173,7 @@ using clang::isTemplateInstantiation;
 using llvm::ArrayRef;
 using llvm::ListSeparator;
 using llvm::PointerUnion;
+using llvm::StringRef;
 using llvm::cast;
 using llvm::dyn_cast;
 using llvm::dyn_cast_or_null;
@@ -184,8 +186,6 @@ using llvm::to_underlying;
 using llvm::zip_equal;
 using std::function;
 using std::pair;
-using std::regex;
-using std::regex_replace;
 using std::vector;
 
 namespace include_what_you_use {
@@ -480,6 +480,7 @@ bool IsCallExprFunRef(const ASTNode* node) {
 // --- Printers.
 
 string PrintableLoc(SourceLocation loc) {
+  SourceManagerLock lock;
   return NormalizeFilePath(loc.printToString(*GlobalSourceManager()));
 }
 
@@ -579,8 +580,60 @@ void PrintStmt(const Stmt* stmt) {
   dumper.Visit(stmt);
 }
 
-string GetWrittenQualifiedNameAsString(const NamedDecl* named_decl,
-                                       bool with_fn_args) {
+// Returns the end of the run of digits starting at pos in str.
+static size_t SkipDigits(StringRef str, size_t pos) {
+  while (pos < str.size() && llvm::isDigit(str[pos]))
+    ++pos;
+  return pos;
+}
+
+// Replaces clang placeholders in partial specialization arguments, like
+// 'type-parameter-0-1', with :N, where N is the parameter index (depth is
+// ignored for now).  The placeholder is
+//   (type|value|template)-parameter-<depth>-<index>
+static string ReplaceTemplateParamPlaceholders(string name) {
+  static const StringRef kParameter = "-parameter-";
+  static const StringRef kKinds[] = {"type", "value", "template"};
+
+  const StringRef text = name;
+  string retval;
+  size_t copied = 0;  // Everything before this is in retval.
+  size_t pos = 0;
+  while ((pos = text.find(kParameter, pos)) != StringRef::npos) {
+    size_t kind_size = 0;
+    for (StringRef kind : kKinds) {
+      if (text.substr(0, pos).ends_with(kind)) {
+        kind_size = kind.size();
+        break;
+      }
+    }
+    const size_t depth_begin = pos + kParameter.size();
+    const size_t depth_end = SkipDigits(text, depth_begin);
+    if (kind_size == 0 || depth_end == depth_begin ||
+        depth_end == text.size() || text[depth_end] != '-') {
+      ++pos;
+      continue;
+    }
+    const size_t index_begin = depth_end + 1;
+    const size_t index_end = SkipDigits(text, index_begin);
+    if (index_end == index_begin) {
+      ++pos;
+      continue;
+    }
+    retval.append(name, copied, pos - kind_size - copied);
+    retval += ':';
+    retval.append(name, index_begin, index_end - index_begin);
+    copied = pos = index_end;
+  }
+
+  if (copied == 0)
+    return name;
+  retval.append(name, copied, string::npos);
+  return retval;
+}
+
+static string PrintWrittenQualifiedName(const NamedDecl* named_decl,
+                                        bool with_fn_args) {
   std::string retval;
   llvm::raw_string_ostream ostream(retval);
   PrintingPolicy printing_policy =
@@ -589,27 +642,42 @@ string GetWrittenQualifiedNameAsString(const NamedDecl* named_decl,
   printing_policy.PrintAsCanonical = true;
   printing_policy.SuppressInlineNamespace =
       to_underlying(PrintingPolicy::SuppressInlineNamespaceMode::All);
-  named_decl->printQualifiedName(ostream, printing_policy);
+  {
+    // Unnamed types (anonymous structs, lambdas...) are printed with their
+    // location, which is looked up in the SourceManager.
+    SourceManagerLock lock;
+    named_decl->printQualifiedName(ostream, printing_policy);
+
+    if (const auto* cls_spec =
+            dyn_cast<ClassTemplateSpecializationDecl>(named_decl)) {
+      PrintExplicitSpecTplArgs(cls_spec, printing_policy, ostream);
+    } else if (const auto* var_spec =
+                   dyn_cast<VarTemplateSpecializationDecl>(named_decl)) {
+      PrintExplicitSpecTplArgs(var_spec, printing_policy, ostream);
+    }
 
-  if (const auto* cls_spec =
-          dyn_cast<ClassTemplateSpecializationDecl>(named_decl)) {
-    PrintExplicitSpecTplArgs(cls_spec, printing_policy, ostream);
-  } else if (const auto* var_spec =
-                 dyn_cast<VarTemplateSpecializationDecl>(named_decl)) {
-    PrintExplicitSpecTplArgs(var_spec, printing_policy, ostream);
+    if (with_fn_args) {
+      if (const auto* fn_decl = dyn_cast<FunctionDecl>(named_decl))
+        PrintFnArgs(fn_decl, printing_policy, ostream);
+    }
   }
 
-  if (with_fn_args) {
-    if (const auto* fn_decl = dyn_cast<FunctionDecl>(named_decl))
-      PrintFnArgs(fn_decl, printing_policy, ostream);
-  }
+  return ReplaceTemplateParamPlaceholders(std::move(retval));
+}
 
-  // Replace clang placeholders in partial specialization arguments with :N,
-  // where N is the parameter index (depth is ignored for now).
-  static regex tpl_param{"(?:type|value|template)-parameter-\\d+-(\\d+)"};
-  retval = regex_replace(retval, tpl_param, ":$1");
+// Names are requested for every use, often several times, so they are
+// memoized.
+const string& GetWrittenQualifiedNameAsString(const NamedDecl* named_decl,
+                                              bool with_fn_args) {
+  WrittenQualifiedNameCache* cache = GlobalWrittenQualifiedNameCache();
+  if (const string* name = cache->Find(named_decl, with_fn_args))
+    return *name;
+  return cache->Insert(named_decl, with_fn_args,
+                       PrintWrittenQualifiedName(named_decl, with_fn_args));
+}
 
-  return retval;
+size_t NumWrittenQualifiedNamesForTesting() {
+  return GlobalWrittenQualifiedNameCache()->size();
 }
 
 // --- Utilities for Template Arguments.
@@ -1447,6 +1515,7 @@ const NamedDecl* GetFirstRedecl(const NamedDecl* decl) {
   SourceManager& sm = *GlobalSourceManager();
   for (const NamedDecl* redecl : all_redecls) {
     SourceLocation redecl_loc = GetLocation(redecl);
+    SourceManagerLock lock;
     if (sm.isBeforeInTranslationUnit(redecl_loc, first_decl_loc)) {
       first_decl = redecl;
       first_decl_loc = redecl_loc;
@@ -1571,7 +1640,8 @@ unsigned GetTplParamNumberWithoutPack(const TemplateDecl* tpl) {
 }
 
 bool IsStdNonProvidingTypedef(const TypedefNameDecl* decl) {
-  string name = GetWrittenQualifiedNameAsString(decl, /*with_fn_args=*/false);
+  const string& name =
+      GetWrittenQualifiedNameAsString(decl, /*with_fn_args=*/false);
   // clang-format off
   static const set<string> typedefs = {
     "std::filebuf",
@@ -434,32 +434,6 @@ class CurrentASTNodeUpdater {
   const ValueSaver<ASTNode*> node_saver_;
 };
 
-// A scope guard to set IsCompleteDefinition to false, and reset it to whatever
-// value it had before on unwind. This is useful when printing declarations, to
-// trick the DeclPrinter into printing less.
-// Does nothing for null inputs, so can be used with dyn_cast[_or_null] with any
-// Decl, but will only have any effect for actual TagDecls.
-class ScopedRemoveDefinition {
- public:
-  explicit ScopedRemoveDefinition(clang::TagDecl* decl)
-      : decl_(decl), oldval_(false) {
-    if (decl_) {
-      oldval_ = decl_->isCompleteDefinition();
-      decl_->setCompleteDefinition(false);
-    }
-  }
-
-  ~ScopedRemoveDefinition() {
-    if (decl_) {
-      decl_->setCompleteDefinition(oldval_);
-    }
-  }
-
- private:
-  clang::TagDecl* decl_;
-  bool oldval_;
-};
-
 // --- Utilities for ASTNode.
 
 // Return true if the given ast_node is inside a C++ method body.  Do
@@ -528,9 +502,13 @@ void PrintStmt(const clang::Stmt* stmt);
 // Written name means name without unwritten scopes.  Unwritten scopes are
 // anonymous and inline namespaces.  Always consider using
 // GetWrittenQualifiedNameAsString instead of
-// NamedDecl::getQualifiedNameAsString.
-string GetWrittenQualifiedNameAsString(const clang::NamedDecl* named_decl,
-                                       bool with_fn_args);
+// NamedDecl::getQualifiedNameAsString.  The result is memoized for the
+// translation unit, and is valid until the next one is set up.
+const string& GetWrittenQualifiedNameAsString(
+    const clang::NamedDecl* named_decl, bool with_fn_args);
+
+// The number of names memoized for this translation unit.  For tests.
+size_t NumWrittenQualifiedNamesForTesting();
 
 // --- Type conversion utilities.
 
@@ -9,22 +9,31 @@
 
 #include "iwyu_cache.h"
 
+#include <iterator>
 #include <set>
 #include <string>
+#include <utility>
 
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclTemplate.h"
 #include "clang/AST/TemplateBase.h"
 #include "clang/Basic/LangOptions.h"
 #include "iwyu_ast_util.h"
+#include "iwyu_location_util.h"
 #include "iwyu_stl_util.h"
+#include "llvm/Support/Casting.h"
 
 using clang::ClassTemplateSpecializationDecl;
+using clang::Decl;
 using clang::LangOptions;
 using clang::NamedDecl;
 using clang::TemplateArgument;
 using clang::TemplateArgumentList;
 using clang::Type;
+using llvm::cast;
+using llvm::dyn_cast;
+using llvm::dyn_cast_or_null;
+using std::pair;
 using std::set;
 using std::string;
 
@@ -35,7 +44,7 @@ namespace include_what_you_use {
 // arguments, and full use of all default templated arguments that
 // the class does not intend-to-provide.  (So vector<MyClass>
 // required full use of MyClass, but not of allocator<MyClass>).
-// TODO(csilvers): put this somewhere easier to modify, and add to it.
+// More can be added with the 'full_use_template' mapping directive.
 static const char* const kFullUseTypes[] = {
     "__gnu_cxx::hash_map",
     "__gnu_cxx::hash_multimap",
@@ -53,48 +62,178 @@ static const char* const kFullUseTypes[] = {
     "std::unordered_set",
 };
 
-// If the passed-in tpl_decl is one of the classes we have hard-coded
-// the full-use type information for, populate the cache with the
+// Before C++17, these required complete element types too.
+static const char* const kPreCXX17FullUseTypes[] = {
+    "std::forward_list",
+    "std::list",
+    "std::vector",
+};
+
+FullUseTemplateCache::FullUseTemplateCache(const LangOptions& lang_opts,
+                                           const set<string>& extra_templates)
+    : template_names_(std::begin(kFullUseTypes), std::end(kFullUseTypes)) {
+  if (!lang_opts.CPlusPlus17) {
+    template_names_.insert(std::begin(kPreCXX17FullUseTypes),
+                           std::end(kPreCXX17FullUseTypes));
+  }
+  InsertAllInto(extra_templates, &template_names_);
+}
+
+bool FullUseTemplateCache::IsFullUseTemplate(const NamedDecl* tpl_decl) {
+  // Implicit specializations are written as the bare template name, so
+  // they can share the answer for their template.  Explicit ones are
+  // written with their arguments, see GetWrittenQualifiedNameAsString.
+  const Decl* key = tpl_decl->getCanonicalDecl();
+  if (const auto* tpl_spec_decl =
+          dyn_cast<ClassTemplateSpecializationDecl>(tpl_decl)) {
+    if (!tpl_spec_decl->isExplicitSpecialization())
+      key = tpl_spec_decl->getSpecializedTemplate()->getCanonicalDecl();
+  }
+  if (const bool* is_full_use_template = FindInMap(&is_full_use_template_, key))
+    return *is_full_use_template;
+
+  const bool is_full_use_template = ContainsKey(
+      template_names_,
+      GetWrittenQualifiedNameAsString(tpl_decl, /*with_fn_args=*/false));
+  is_full_use_template_[key] = is_full_use_template;
+  return is_full_use_template;
+}
+
+// If the passed-in type is a specialization of one of the templates
+// we have hard-coded the full-use type information for, return the
 // appropriate full-use type information for the given instantiation.
-// Note that we only populate the cache for class member uses, not
+// Note that we only use this cache for class member uses, not
 // function calls -- that is, we can use the hard-coded data to say
 // full use-info for 'sizeof(vector<MyClass>)', but not for
 // 'myclass_vector.clear();'.  This is because the former never tries
 // to instantiate methods, making the hard-coding much easier.
-map<const Type*, const Type*> FullUseCache::GetPrecomputedResugarMap(
-    const Type* type, const LangOptions& lang_opts) {
-  static const int fulluse_size =
-      (sizeof(kFullUseTypes) / sizeof(*kFullUseTypes));
-  set<string> fulluse_types(kFullUseTypes, kFullUseTypes + fulluse_size);
-  if (!lang_opts.CPlusPlus17)
-    fulluse_types.insert({"std::forward_list", "std::list", "std::vector"});
+const map<const Type*, const Type*>& FullUseTemplateCache::GetResugarMap(
+    const Type* type) {
+  if (const map<const Type*, const Type*>* resugar_map =
+          FindInMap(&resugar_maps_, type))
+    return *resugar_map;
 
+  map<const Type*, const Type*>& resugar_map = resugar_maps_[type];
   const NamedDecl* tpl_decl = TypeToDeclAsWritten(type);
   if (!tpl_decl)  // This probably means that the template name is dependent.
-    return map<const Type*, const Type*>();
-  if (!ContainsKey(fulluse_types, GetWrittenQualifiedNameAsString(
-                                      tpl_decl, /*with_fn_args=*/false)))
-    return map<const Type*, const Type*>();
-
-  // The code below doesn't handle template-template args/etc.  None
-  // of the types in kFullUseTypes should have those.  Just verify,
-  // when we can.
-  if (const ClassTemplateSpecializationDecl* tpl_spec_decl =
-          DynCastFrom(tpl_decl)) {
-    const TemplateArgumentList& all_tpl_args = tpl_spec_decl->getTemplateArgs();
-    for (unsigned i = 0; i < all_tpl_args.size(); ++i) {
-      CHECK_((all_tpl_args.get(i).getKind() == TemplateArgument::Type) &&
-             "kFullUseType types must contain only 'type' template args");
-    }
-  }
+    return resugar_map;
+  if (!IsFullUseTemplate(tpl_decl))
+    return resugar_map;
 
   // The default resugar-map works correctly for all these types (by
-  // design): we fully use all template types.  (Note: we'll have to
-  // do something more clever here if any types in kFullUseTypes start
-  // accepting template-template types.)
-  return GetTplInstDataForClassNoComponentTypes(
-             type, [](const Type* type) { return set<const Type*>(); })
-      .resugar_map;
+  // design): we fully use all template types.  Non-type template args,
+  // like the N in a small-vector<T, N>, have nothing to resugar and are
+  // just skipped.
+  resugar_map = GetTplInstDataForClassNoComponentTypes(
+                    type, [](const Type* type) { return set<const Type*>(); })
+                    .resugar_map;
+  return resugar_map;
+}
+
+PrivateWrapperTemplateCache::PrivateWrapperTemplateCache(
+    const map<string, size_t>& extra_templates) {
+  for (const auto& [name, type_arg_idx] : extra_templates)
+    rules_by_name_[name] = {TemplateKind::kWrapper, 0, type_arg_idx};
+
+  // __normal_iterator<foo, vector> maps to vector<>, __wrap_iter<foo> to
+  // foo.
+  rules_by_name_["__gnu_cxx::__normal_iterator"] = {TemplateKind::kWrapper, 2,
+                                                    1};
+  rules_by_name_["std::__wrap_iter"] = {TemplateKind::kWrapper, 1, 0};
+  rules_by_name_["std::reverse_iterator"] = {TemplateKind::kReverseIterator, 1,
+                                             0};
+  // The list iterators from GNU libstdc++ (in stl_list.h) and libc++ (in
+  // list) are defined where we want them, so they don't need re-mapping
+  // themselves, but reverse_iterator<_List_iterator> is mapped to
+  // _List_iterator so that it ends up in the list header too.
+  rules_by_name_["std::_List_iterator"] = {TemplateKind::kListIterator, 1, 0};
+  rules_by_name_["std::_List_const_iterator"] = {TemplateKind::kListIterator,
+                                                 1, 0};
+  rules_by_name_["std::__list_iterator"] = {TemplateKind::kListIterator, 2, 0};
+  rules_by_name_["std::__list_const_iterator"] = {TemplateKind::kListIterator,
+                                                  2, 0};
+}
+
+const PrivateWrapperTemplateCache::TemplateRule*
+PrivateWrapperTemplateCache::GetRule(const NamedDecl* decl) {
+  const auto* tpl_spec_decl =
+      dyn_cast_or_null<ClassTemplateSpecializationDecl>(decl);
+  if (!tpl_spec_decl)
+    return nullptr;
+
+  // As in FullUseTemplateCache::IsFullUseTemplate, implicit
+  // specializations share the rule of their template.
+  const Decl* key = tpl_spec_decl->getCanonicalDecl();
+  if (!tpl_spec_decl->isExplicitSpecialization())
+    key = tpl_spec_decl->getSpecializedTemplate()->getCanonicalDecl();
+  const TemplateRule* rule = FindInMap(&rules_by_template_, key);
+  if (!rule) {
+    const TemplateRule* named_rule = FindInMap(
+        &rules_by_name_,
+        GetWrittenQualifiedNameAsString(tpl_spec_decl, /*with_fn_args=*/false));
+    TemplateRule& new_rule = rules_by_template_[key];
+    if (named_rule)
+      new_rule = *named_rule;
+    rule = &new_rule;
+  }
+  if (rule->kind == TemplateKind::kOther)
+    return nullptr;
+
+  const TemplateArgumentList& tpl_args = tpl_spec_decl->getTemplateArgs();
+  if (rule->num_args != 0 && tpl_args.size() != rule->num_args)
+    return nullptr;
+  if (rule->type_arg_idx >= tpl_args.size() ||
+      tpl_args.get(rule->type_arg_idx).getKind() != TemplateArgument::Type)
+    return nullptr;
+  return rule;
+}
+
+const Type* PrivateWrapperTemplateCache::GetPublicType(const NamedDecl* decl) {
+  const TemplateRule* rule = GetRule(decl);
+  if (!rule)
+    return nullptr;
+
+  // GetRule has checked that decl has the type argument.
+  auto type_arg = [](const NamedDecl* decl, const TemplateRule* rule) {
+    return cast<ClassTemplateSpecializationDecl>(decl)
+        ->getTemplateArgs()
+        .get(rule->type_arg_idx)
+        .getAsType()
+        .getTypePtr();
+  };
+
+  // reverse_iterator<x> maps like x, except that reverse_iterator of a
+  // list iterator maps to the list iterator.
+  if (rule->kind == TemplateKind::kReverseIterator) {
+    const Type* reversed_iterator_type = type_arg(decl, rule);
+    decl = TypeToDeclAsWritten(reversed_iterator_type);
+    rule = GetRule(decl);
+    if (!rule)
+      return nullptr;
+    if (rule->kind == TemplateKind::kListIterator)
+      return reversed_iterator_type;
+  }
+
+  if (rule->kind == TemplateKind::kWrapper)
+    return type_arg(decl, rule);
+  return nullptr;
+}
+
+const string* WrittenQualifiedNameCache::Find(const NamedDecl* decl,
+                                              bool with_fn_args) {
+  ParallelCalculationLock lock(mutex_);
+  const pair<const NamedDecl*, bool> key(decl, with_fn_args);
+  const string* const* name = FindInMap(&names_by_decl_, key);
+  return name ? *name : nullptr;
+}
+
+const string& WrittenQualifiedNameCache::Insert(const NamedDecl* decl,
+                                                bool with_fn_args,
+                                                string name) {
+  ParallelCalculationLock lock(mutex_);
+  const string* memoized = &*names_.insert(std::move(name)).first;
+  names_by_decl_.emplace(std::make_pair(decl, with_fn_args), memoized);
+  return *memoized;
 }
 
 }  // namespace include_what_you_use
@@ -15,15 +15,26 @@
 #ifndef INCLUDE_WHAT_YOU_USE_IWYU_CACHE_H_
 #define INCLUDE_WHAT_YOU_USE_IWYU_CACHE_H_
 
+#include <algorithm>                    // for sort
+#include <cstddef>                      // for size_t
+#include <functional>                   // for less
 #include <map>                          // for map
+#include <mutex>                        // for mutex
 #include <set>                          // for set
+#include <string>                       // for string
 #include <utility>                      // for pair
 
 #include "clang/AST/Type.h"
+#include "iwyu_arena.h"
+#include "iwyu_globals.h"
 #include "iwyu_port.h"  // for CHECK_
 #include "iwyu_stl_util.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace clang {
+class Decl;
 class LangOptions;
 class NamedDecl;
 }
@@ -33,6 +44,7 @@ namespace include_what_you_use {
 using std::map;
 using std::pair;
 using std::set;
+using std::string;
 
 // This cache is used to store 'full use information' for a given
 // templated function call or type instantiation:
@@ -61,17 +73,20 @@ class FullUseCache {
   // what the types-of-interest were, we store that in the key too.
   typedef pair<const void*,
                map<const clang::Type*, const clang::Type*>> Key;
-  // The value are the types and decls we reported.
-  typedef pair<const set<const clang::Type*>,
-               const set<const clang::NamedDecl*>> Value;
+  // The value are the types and decls we reported, in pointer order (as a
+  // set would have them).  They are stored in the translation unit's arena.
+  typedef pair<llvm::ArrayRef<const clang::Type*>,
+               llvm::ArrayRef<const clang::NamedDecl*>> Value;
 
   void Insert(const void* decl_or_type,
               const map<const clang::Type*, const clang::Type*>& resugar_map,
-              const set<const clang::Type*>& reported_types,
-              const set<const clang::NamedDecl*>& reported_decls) {
+              const llvm::SmallPtrSetImpl<const clang::Type*>& reported_types,
+              const llvm::SmallPtrSetImpl<const clang::NamedDecl*>&
+                  reported_decls) {
     // TODO(csilvers): should in_forward_declare_context() be in Key too?
-    cache_.insert(pair<Key,Value>(Key(decl_or_type, resugar_map),
-                                  Value(reported_types, reported_decls)));
+    cache_.emplace(Key(decl_or_type, resugar_map),
+                   Value(CopyToArena(reported_types),
+                         CopyToArena(reported_decls)));
   }
 
   // resguar_map is the 'uncanonicalize' map for the template
@@ -84,7 +99,7 @@ class FullUseCache {
 
   // You must call Contains() before calling these, to make sure the
   // key is in the cache.
-  const set<const clang::Type*>& GetFullUseTypes(
+  llvm::ArrayRef<const clang::Type*> GetFullUseTypes(
       const void* key,
       const map<const clang::Type*, const clang::Type*>& resugar_map) const {
     const Value* value = FindInMap(&cache_, Key(key, resugar_map));
@@ -92,7 +107,7 @@ class FullUseCache {
     return value->first;
   }
 
-  const set<const clang::NamedDecl*>& GetFullUseDecls(
+  llvm::ArrayRef<const clang::NamedDecl*> GetFullUseDecls(
       const void* key,
       const map<const clang::Type*, const clang::Type*>& resugar_map) const {
     const Value* value = FindInMap(&cache_, Key(key, resugar_map));
@@ -101,25 +116,107 @@ class FullUseCache {
   }
 
   // In addition to the normal cache, which is filled via Insert()
-  // calls, we also have a special, hard-coded cache holding full-use
-  // type information for common STL types.  Note that since we only
-  // have full-use type information, and not full-use decl
-  // information, this cache is only appropriate when instantiating a
-  // type ('sizeof(vector<MyClass>)'), not when making a function call
-  // ('myclass_vector->clear()').
-  //    NOTE: because this cache is hard-coded, the types may not be
-  // sugared properly: the output might be 'MyUnderlyingType' when the
-  // input is 'vector<MyTypedef>'.  You will have to resugar yourself.
-  // That is why this is implemented in a different function, and not
-  // available via GetFullUseType(), which does not have this problem
-  // with sugaring.
-  static map<const clang::Type*, const clang::Type*> GetPrecomputedResugarMap(
-      const clang::Type*, const clang::LangOptions&);
+  // calls, there is a special, hard-coded cache holding full-use type
+  // information for common STL types.  See FullUseTemplateCache below.
 
  private:
+  template <typename T>
+  static llvm::ArrayRef<T> CopyToArena(const llvm::SmallPtrSetImpl<T>& values) {
+    llvm::SmallVector<T, 8> sorted(values.begin(), values.end());
+    std::sort(sorted.begin(), sorted.end(), std::less<T>());
+    return GlobalArena()->Copy<T>(sorted);
+  }
+
   map<Key, Value> cache_;
 };
 
+// This cache holds hard-coded full-use type information for container
+// templates like std::set and std::map: instantiating such a type
+// requires full use of all explicitly-listed template arguments, and
+// full use of all default template arguments that the class does not
+// intend-to-provide.  (So vector<MyClass> requires full use of MyClass,
+// but not of allocator<MyClass>.)  Mapping files can add more templates
+// with the 'full_use_template' directive.
+//    Note that since we only have full-use type information, and not
+// full-use decl information, this cache is only appropriate when
+// instantiating a type ('sizeof(vector<MyClass>)'), not when making a
+// function call ('myclass_vector->clear()').
+//    NOTE: because this cache is hard-coded, the types may not be
+// sugared properly: the output might be 'MyUnderlyingType' when the
+// input is 'vector<MyTypedef>'.  You will have to resugar yourself.
+// That is why this is implemented in a different class, and not
+// available via FullUseCache::GetFullUseTypes(), which does not have
+// this problem with sugaring.
+class FullUseTemplateCache {
+ public:
+  // extra_templates are qualified template names, e.g. "absl::btree_set",
+  // in addition to the hard-coded ones.
+  FullUseTemplateCache(const clang::LangOptions& lang_opts,
+                       const set<string>& extra_templates);
+
+  // If type is a specialization of one of the full-use templates,
+  // returns the resugar map for its template arguments, which are all
+  // fully used.  Otherwise returns an empty map.
+  const map<const clang::Type*, const clang::Type*>& GetResugarMap(
+      const clang::Type* type);
+
+ private:
+  bool IsFullUseTemplate(const clang::NamedDecl* tpl_decl);
+
+  // Qualified names of all the full-use templates.
+  set<string> template_names_;
+  // Whether a decl is a full-use template.  Implicit specializations
+  // are looked up by their canonical ClassTemplateDecl, so the name is
+  // only computed once per template.
+  map<const clang::Decl*, bool> is_full_use_template_;
+  // Resugar maps by instantiated type.
+  map<const clang::Type*, map<const clang::Type*, const clang::Type*>>
+      resugar_maps_;
+};
+
+// This cache holds the private class templates whose specializations
+// stand for one of their type arguments, like __gnu_cxx::__normal_iterator
+// or std::__wrap_iter: they should not be exposed to the user, who sees
+// them through typedefs like vector::iterator.  When the typedef is lost,
+// as in find(myvec.begin(), myvec.end(), foo), uses of the wrapper are
+// attributed to the wrapped type (vector<> for __normal_iterator<foo,
+// vector>, assuming vector<> provides the typedef).  reverse_iterator of
+// such a wrapper is mapped the same way.  Mapping files can add more
+// templates with the 'private_wrapper_template' directive.
+//    The rule for a template is resolved once, by its canonical decl, so
+// the hot path does not need to compute any names.
+class PrivateWrapperTemplateCache {
+ public:
+  // extra_templates maps qualified template names, e.g.
+  // "mylib::IteratorWrapper", to the index of their wrapped type argument,
+  // in addition to the hard-coded ones.
+  explicit PrivateWrapperTemplateCache(
+      const map<string, size_t>& extra_templates);
+
+  // If decl is a specialization of a private wrapper template (or a
+  // reverse_iterator of one), returns the wrapped type.  Otherwise
+  // returns nullptr.
+  const clang::Type* GetPublicType(const clang::NamedDecl* decl);
+
+ private:
+  enum class TemplateKind { kOther, kWrapper, kReverseIterator, kListIterator };
+
+  struct TemplateRule {
+    TemplateKind kind = TemplateKind::kOther;
+    size_t num_args = 0;  // 0 means any number of arguments
+    size_t type_arg_idx = 0;
+  };
+
+  // Returns the rule for decl, if it is a class template specialization
+  // with the arguments its rule expects, or nullptr.
+  const TemplateRule* GetRule(const clang::NamedDecl* decl);
+
+  // Rules by qualified template name.
+  map<string, TemplateRule> rules_by_name_;
+  // Rules by template, see FullUseTemplateCache::IsFullUseTemplate.
+  map<const clang::Decl*, TemplateRule> rules_by_template_;
+};
+
 // This class allows us to update multiple cache entries at once.
 // For instance, suppose A<Foo, Bar>() calls B<Foo, Bar>(), which
 // requires the full type info for Foo.  Then we want to add a cache
@@ -162,8 +259,33 @@ class CacheStoringScope {
   FullUseCache* const cache_;
   const void* const key_;
   const map<const clang::Type*, const clang::Type*>& resugar_map_;
-  set<const clang::Type*> reported_types_;
-  set<const clang::NamedDecl*> reported_decls_;
+  // Most scopes only see a few uses, so collect them without allocating
+  // a tree node for each; the cache entry is built once, at the end.
+  llvm::SmallPtrSet<const clang::Type*, 8> reported_types_;
+  llvm::SmallPtrSet<const clang::NamedDecl*, 8> reported_decls_;
+};
+
+// The memo of GetWrittenQualifiedNameAsString, for one translation unit,
+// so decls are unique keys.  Equal names (e.g. of redeclarations) share
+// storage.  The include-picker asks for names while it resolves the public
+// headers of uses, which --jobs does for several files at once.
+class WrittenQualifiedNameCache {
+ public:
+  // Returns the memoized name, or nullptr if there is none yet.
+  const string* Find(const clang::NamedDecl* decl, bool with_fn_args);
+
+  // Memoizes name for decl, and returns the memoized copy.
+  const string& Insert(const clang::NamedDecl* decl, bool with_fn_args,
+                       string name);
+
+  size_t size() const {
+    return names_by_decl_.size();
+  }
+
+ private:
+  std::mutex mutex_;
+  map<pair<const clang::NamedDecl*, bool>, const string*> names_by_decl_;
+  set<string> names_;
 };
 
 }  // namespace include_what_you_use
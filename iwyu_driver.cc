@@ -50,6 +50,7 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/TargetParser/Host.h"
 
@@ -63,6 +64,7 @@ using clang::CompilerInvocation;
 using clang::DiagnosticOptions;
 using clang::DiagnosticsEngine;
 using clang::FrontendAction;
+using clang::FrontendOptions;
 using clang::GetResourcesPath;
 using clang::PreprocessorOptions;
 using clang::driver::Action;
@@ -421,8 +423,34 @@ bool ExecuteAction(int argc,
       return false;
   }
 
+  // Clang starts the time-trace profiler in cc1_main, which we bypass, so
+  // start it here.  This also enables IWYU's own time-trace scopes.
+  const FrontendOptions& frontend_opts = compiler->getFrontendOpts();
+  if (!frontend_opts.TimeTracePath.empty()) {
+    llvm::timeTraceProfilerInitialize(frontend_opts.TimeTraceGranularity,
+                                      iwyu_executable_path);
+  }
+
   // Run the action.
-  return compiler->ExecuteAction(*action);
+  const bool success = compiler->ExecuteAction(*action);
+  WriteTimeTrace(compiler.get());
+  return success;
+}
+
+void WriteTimeTrace(CompilerInstance* compiler) {
+  if (!llvm::timeTraceProfilerEnabled())
+    return;
+
+  const std::string& path = compiler->getFrontendOpts().TimeTracePath;
+  if (unique_ptr<llvm::raw_pwrite_stream> output =
+          compiler->createOutputFile(path, /*Binary=*/false,
+                                     /*RemoveFileOnSignal=*/false,
+                                     /*UseTemporary=*/false)) {
+    llvm::timeTraceProfilerWrite(*output);
+    output.reset();
+    compiler->clearOutputFiles(/*EraseFiles=*/false);
+  }
+  llvm::timeTraceProfilerCleanup();
 }
 
 }  // namespace include_what_you_use
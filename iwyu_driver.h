@@ -14,6 +14,7 @@
 #include <memory>
 
 namespace clang {
+class CompilerInstance;
 class FrontendAction;
 
 namespace driver {
@@ -34,6 +35,13 @@ typedef std::function<std::unique_ptr<FrontendAction>(const ToolChain&)>
 // via factory callback.
 bool ExecuteAction(int argc, const char** argv, ActionFactory make_iwyu_action);
 
+// If ExecuteAction started a time-trace profile (-ftime-trace), writes it to
+// the requested file and stops profiling.  Otherwise does nothing.  Unless it
+// reports to an IwyuResult, the IWYU action exits the process from inside
+// ExecuteAction, so it must call this before exiting for the trace to be
+// written at all.
+void WriteTimeTrace(clang::CompilerInstance* compiler);
+
 }  // namespace include_what_you_use
 
 #endif  // INCLUDE_WHAT_YOU_USE_IWYU_DRIVER_H_
@@ -15,6 +15,7 @@
 #include <cstdlib>                      // for atoi, exit, getenv
 #include <cstring>
 #include <map>                          // for map
+#include <mutex>
 #include <set>                          // for set
 #include <string>                       // for string, operator<, etc
 #include <utility>                      // for make_pair, pair
@@ -28,6 +29,7 @@
 #include "clang/Lex/DirectoryLookup.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/Preprocessor.h"
+#include "iwyu_arena.h"
 #include "iwyu_cache.h"
 #include "iwyu_getopt.h"
 #include "iwyu_include_picker.h"
@@ -66,8 +68,13 @@ static const PrintingPolicy default_print_policy(default_lang_options);
 static SourceManagerCharacterDataGetter* data_getter = nullptr;
 static FullUseCache* function_calls_full_use_cache = nullptr;
 static FullUseCache* class_members_full_use_cache = nullptr;
+static FullUseTemplateCache* full_use_template_cache = nullptr;
+static PrivateWrapperTemplateCache* private_wrapper_template_cache = nullptr;
+static WrittenQualifiedNameCache* written_qualified_name_cache = nullptr;
+static Arena* arena = nullptr;
 static int ParseIwyuCommandlineFlags(int argc, char** argv);
 static int ParseInterceptedCommandlineFlags(int argc, char** argv);
+static void ClearFileGlobMatches();
 
 static void PrintHelp(const char* extra_msg) {
   printf("USAGE: include-what-you-use [-Xiwyu --iwyu_opt]... <clang opts>"
@@ -134,6 +141,22 @@ static void PrintHelp(const char* extra_msg) {
          "                          mappings instead of internal mappings\n"
          "   --use_c_headers: suggest C standard library headers in C++ mode\n"
          "        instead of their C++ counterparts\n"
+         "   --jobs=<N>: calculate iwyu violations for the reported files\n"
+         "        using N threads (default: 1).  Output is the same as for a\n"
+         "        single thread.\n"
+         "   --check_only: only find out whether there are iwyu violations,\n"
+         "        e.g. for CI.  Skips building the suggested edits, stops at\n"
+         "        the first file with violations and prints only its name.\n"
+         "        Use with --error to get a failing exit code.\n"
+         "   --standalone_header=<file>: analyze the header <file> on its\n"
+         "        own, in a translation unit that only #includes it, instead\n"
+         "        of the source file.  The source file only provides the\n"
+         "        compile flags, so pick one that the header compiles with.\n"
+         "   --dependency_file=<file>: write the path of every file the\n"
+         "        translation unit includes, directly or indirectly, and of\n"
+         "        every mapping file used, to <file>, one per line.  Used by\n"
+         "        iwyu_tool.py --watch to find the translation units to\n"
+         "        re-analyze when a file changes.\n"
          "\n"
          "In addition to IWYU-specific options you can specify the following\n"
          "options without -Xiwyu prefix:\n"
@@ -224,9 +247,11 @@ CommandlineFlags::CommandlineFlags()
       exit_code_error(EXIT_SUCCESS),
       exit_code_always(EXIT_SUCCESS),
       regex_dialect(RegexDialect::LLVM),
-      use_c_headers(false) {
+      use_c_headers(false),
+      jobs(1),
+      check_only(false) {
   // Always keep Qt .moc includes; its moc compiler does its own IWYU analysis.
-  keep.emplace("*.moc");
+  keep.Insert("*.moc");
 }
 
 int CommandlineFlags::ParseArgv(int argc, char** argv) {
@@ -254,6 +279,10 @@ int CommandlineFlags::ParseArgv(int argc, char** argv) {
     {"experimental", required_argument, nullptr, 'p'},
     {"export_mappings", required_argument, nullptr, 'E'},
     {"use_c_headers", no_argument, nullptr, 'U'},
+    {"jobs", required_argument, nullptr, 'j'},
+    {"check_only", no_argument, nullptr, 'K'},
+    {"standalone_header", required_argument, nullptr, 'H'},
+    {"dependency_file", required_argument, nullptr, 'D'},
     {nullptr, 0, nullptr, 0}
   };
   static const char shortopts[] = "v:c:m:d:nr";
@@ -357,6 +386,15 @@ int CommandlineFlags::ParseArgv(int argc, char** argv) {
         break;
       }
       case 'U': use_c_headers = true; break;
+      case 'j':
+        if (!ParseIntegerOptarg(optarg, &jobs) || jobs < 1) {
+          PrintHelp("FATAL ERROR: --jobs argument must be a positive integer.");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'K': check_only = true; break;
+      case 'H': standalone_header = optarg; break;
+      case 'D': dependency_file = optarg; break;
       case -1:
         return optind;  // means 'no more input'
       default:
@@ -490,6 +528,22 @@ static CXXStdLib DeriveCXXStdLib(const CompilerInstance& compiler,
 }
 
 void InitGlobals(CompilerInstance& compiler, const ToolChain& toolchain) {
+  // When translation units are analyzed in-process (see RunIwyu), this runs
+  // once for each of them, so drop what was set up for the previous one.
+  delete data_getter;
+  delete include_picker;
+  delete function_calls_full_use_cache;
+  delete class_members_full_use_cache;
+  delete full_use_template_cache;
+  delete private_wrapper_template_cache;
+  delete written_qualified_name_cache;
+  // Everything allocated from the arena went with the previous translation
+  // unit, including the entries of the caches deleted above.
+  delete arena;
+  ClearFileGlobMatches();
+
+  arena = new Arena;
+
   source_manager = &compiler.getSourceManager();
   data_getter = new SourceManagerCharacterDataGetter(*source_manager);
   vector<HeaderSearchPath> search_paths = ComputeHeaderSearchPaths(
@@ -499,10 +553,14 @@ void InitGlobals(CompilerInstance& compiler, const ToolChain& toolchain) {
   RegexDialect regex_dialect = GlobalFlags().regex_dialect;
   CStdLib cstdlib = DeriveCStdLib();
   CXXStdLib cxxstdlib = DeriveCXXStdLib(compiler, toolchain);
-  include_picker = new IncludePicker(regex_dialect, cstdlib, cxxstdlib);
+  // The internal and mapping-file mappings are shared, only the mappings
+  // added while processing this translation unit are the picker's own.
+  include_picker = new IncludePicker(IncludePicker::GetMappingSnapshot(
+      regex_dialect, cstdlib, cxxstdlib, GlobalFlags().mapping_files));
 
   function_calls_full_use_cache = new FullUseCache;
   class_members_full_use_cache = new FullUseCache;
+  written_qualified_name_cache = new WrittenQualifiedNameCache;
 
   for (const HeaderSearchPath& entry : search_paths) {
     const char* path_type_name =
@@ -511,10 +569,16 @@ void InitGlobals(CompilerInstance& compiler, const ToolChain& toolchain) {
              << ")\n";
   }
 
-  // Add mappings.
-  for (const string& mapping_file : GlobalFlags().mapping_files) {
-    include_picker->AddMappingsFromFile(mapping_file);
-  }
+  full_use_template_cache = new FullUseTemplateCache(
+      compiler.getLangOpts(), include_picker->GetFullUseTemplates());
+  private_wrapper_template_cache = new PrivateWrapperTemplateCache(
+      include_picker->GetPrivateWrapperTemplates());
+}
+
+void SetGlobalFlags(const CommandlineFlags& flags) {
+  delete commandline_flags;
+  commandline_flags = new CommandlineFlags(flags);
+  SetVerboseLevel(commandline_flags->verbose);
 }
 
 const CommandlineFlags& GlobalFlags() {
@@ -559,32 +623,72 @@ FullUseCache* ClassMembersFullUseCache() {
   return class_members_full_use_cache;
 }
 
+FullUseTemplateCache* GlobalFullUseTemplateCache() {
+  CHECK_(full_use_template_cache && "Must call InitGlobals() before this");
+  return full_use_template_cache;
+}
+
+PrivateWrapperTemplateCache* GlobalPrivateWrapperTemplateCache() {
+  CHECK_(private_wrapper_template_cache &&
+         "Must call InitGlobals() before this");
+  return private_wrapper_template_cache;
+}
+
+Arena* GlobalArena() {
+  CHECK_(arena && "Must call InitGlobals() before this");
+  return arena;
+}
+
+WrittenQualifiedNameCache* GlobalWrittenQualifiedNameCache() {
+  CHECK_(written_qualified_name_cache && "Must call InitGlobals() before this");
+  return written_qualified_name_cache;
+}
+
+// Memoized results of matching files against the check_also and keep globs.
+// Besides during preprocessing, files are matched when their desired
+// includes are calculated, on several threads with --jobs.
+static std::mutex glob_match_mutex;
+static map<OptionalFileEntryRef, bool> report_violations_for_file;
+static map<OptionalFileEntryRef, bool> keep_includes_for_file;
+
+static bool FileMatchesGlobs(OptionalFileEntryRef file, const GlobSet& globs,
+                             map<OptionalFileEntryRef, bool>* cache) {
+  ParallelCalculationLock lock(glob_match_mutex);
+  auto [it, inserted] = cache->try_emplace(file, false);
+  if (inserted)
+    it->second = globs.Matches(GetFilePath(file));
+  return it->second;
+}
+
+static void ClearFileGlobMatches() {
+  ParallelCalculationLock lock(glob_match_mutex);
+  report_violations_for_file.clear();
+  keep_includes_for_file.clear();
+}
+
 void AddGlobToReportIWYUViolationsFor(const string& glob) {
   CHECK_(commandline_flags && "Call ParseIwyuCommandlineFlags() before this");
-  commandline_flags->check_also.insert(NormalizeFilePath(glob));
+  ParallelCalculationLock lock(glob_match_mutex);
+  commandline_flags->check_also.Insert(NormalizeFilePath(glob));
+  report_violations_for_file.clear();
 }
 
 bool ShouldReportIWYUViolationsFor(OptionalFileEntryRef file) {
-  const string filepath = GetFilePath(file);
-  for (const string& glob : GlobalFlags().check_also)
-    if (GlobMatchesPath(glob.c_str(), filepath.c_str()))
-      return true;
-  return false;
+  return FileMatchesGlobs(file, GlobalFlags().check_also,
+                          &report_violations_for_file);
 }
 
 void AddGlobToKeepIncludes(const string& glob) {
   CHECK_(commandline_flags && "Call ParseIwyuCommandlineFlags() before this");
-  commandline_flags->keep.insert(NormalizeFilePath(glob));
+  ParallelCalculationLock lock(glob_match_mutex);
+  commandline_flags->keep.Insert(NormalizeFilePath(glob));
+  keep_includes_for_file.clear();
 }
 
 bool ShouldKeepIncludeFor(OptionalFileEntryRef file) {
   if (GlobalFlags().keep.empty())
     return false;
-  const string filepath = GetFilePath(file);
-  for (const string& glob : GlobalFlags().keep)
-    if (GlobMatchesPath(glob.c_str(), filepath.c_str()))
-      return true;
-  return false;
+  return FileMatchesGlobs(file, GlobalFlags().keep, &keep_includes_for_file);
 }
 
 void InitGlobalsAndFlagsForTesting() {
@@ -606,8 +710,10 @@ void InitGlobalsAndFlagsForTesting() {
   include_picker =
       new IncludePicker(GlobalFlags().regex_dialect, cstdlib, cxxstdlib);
 
+  arena = new Arena;
   function_calls_full_use_cache = new FullUseCache;
   class_members_full_use_cache = new FullUseCache;
+  written_qualified_name_cache = new WrittenQualifiedNameCache;
 
   // Use a reasonable default for the -I flags.
   map<string, HeaderSearchPath::Type> search_path_map;
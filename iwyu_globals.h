@@ -16,6 +16,7 @@
 #include <vector>                       // for vector
 
 #include "clang/Basic/FileEntry.h"
+#include "iwyu_path_util.h"
 
 namespace clang {
 class CompilerInstance;
@@ -33,9 +34,13 @@ using std::set;
 using std::string;
 using std::vector;
 
+class Arena;
 class FullUseCache;
+class FullUseTemplateCache;
 class IncludePicker;
+class PrivateWrapperTemplateCache;
 class SourceManagerCharacterDataGetter;
+class WrittenQualifiedNameCache;
 enum class RegexDialect;
 
 // To set up the global state you need to parse options with OptionsParser when
@@ -90,8 +95,8 @@ struct CommandlineFlags {
   bool HasDebugFlag(const char* flag) const;
   bool HasExperimentalFlag(const char* flag) const;
 
-  set<string> check_also;  // -c: globs to report iwyu violations for
-  set<string> keep;        // -k: globs to force-keep includes for
+  GlobSet check_also;      // -c: globs to report iwyu violations for
+  GlobSet keep;            // -k: globs to force-keep includes for
   bool transitive_includes_only;   // -t: don't add 'new' #includes to files
   int verbose;             // -v: how much information to emit as we parse
   vector<string> mapping_files; // -m: mapping files
@@ -113,8 +118,16 @@ struct CommandlineFlags {
   set<string> exp_flags;       // Experimental flags.
   RegexDialect regex_dialect;  // Dialect for regular expression processing.
   bool use_c_headers;  // Force use C standard library headers in C++ mode.
+  int jobs;  // Number of threads to calculate iwyu violations with.
+  bool check_only;  // Only find out whether there are iwyu violations.
+  string standalone_header;  // Header to analyze in a TU of its own.
+  string dependency_file;  // Where to list the files the TU depends on.
 };
 
+// Replaces the flags, instead of parsing them with OptionsParser.  For
+// running IWYU as a library (see RunIwyu).
+void SetGlobalFlags(const CommandlineFlags& flags);
+
 const CommandlineFlags& GlobalFlags();
 // Used by tests as an easy way to simulate calling with different --flags.
 CommandlineFlags* MutableGlobalFlagsForTesting();
@@ -135,9 +148,25 @@ const SourceManagerCharacterDataGetter& DefaultDataGetter();
 FullUseCache* FunctionCallsFullUseCache();
 FullUseCache* ClassMembersFullUseCache();
 
+// Hard-coded full-use information for container templates like
+// std::map, plus those listed in mapping files.
+FullUseTemplateCache* GlobalFullUseTemplateCache();
+
+// Hard-coded private wrapper templates like __gnu_cxx::__normal_iterator,
+// plus those listed in mapping files.
+PrivateWrapperTemplateCache* GlobalPrivateWrapperTemplateCache();
+
+// The arena of the translation unit being analyzed, see iwyu_arena.h.
+Arena* GlobalArena();
+
+// The memoized written names of the decls in this translation unit, see
+// GetWrittenQualifiedNameAsString.
+WrittenQualifiedNameCache* GlobalWrittenQualifiedNameCache();
+
 // These files are based on the commandline (--check_also flag plus argv).
 // They are specified as glob file-patterns (which behave just as they
 // do in the shell).  TODO(csilvers): use a prefix instead? allow '...'?
+// Results are memoized per file until the next glob is added.
 void AddGlobToReportIWYUViolationsFor(const string& glob);
 bool ShouldReportIWYUViolationsFor(clang::OptionalFileEntryRef file);
 
@@ -15,10 +15,12 @@
 // not hash_map: it's not as portable and needs hash<string>.
 #include <map>                          // for map, map<>::mapped_type, etc
 #include <memory>
+#include <mutex>                        // for mutex, lock_guard
 #include <numeric>                      // for accumulate
 #include <optional>
 #include <string>                       // for string, basic_string, etc
 #include <system_error>                 // for error_code
+#include <tuple>                        // for tuple
 #include <type_traits>
 #include <utility>                      // for pair, make_pair
 #include <vector>                       // for vector, vector<>::iterator
@@ -35,6 +37,7 @@
 #include "iwyu_stl_util.h"
 #include "iwyu_string_util.h"
 #include "iwyu_verrs.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
@@ -46,6 +49,7 @@
 #include "llvm/Support/Format.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/YAMLParser.h"
 
 using clang::NamedDecl;
@@ -68,7 +72,9 @@ using std::make_pair;
 using std::map;
 using std::optional;
 using std::pair;
+using std::shared_ptr;
 using std::string;
+using std::tuple;
 using std::unique_ptr;
 using std::vector;
 
@@ -1345,8 +1351,11 @@ bool IsQuotedFilepathPattern(const string& str) {
 // Given a vector of nodes, augment each node with its children, as
 // defined by m: nodes[i] is replaced by nodes[i] + m[nodes[i]],
 // ignoring duplicates.  The input vector is modified in place.
+// Nodes that aren't keys of m take their children from fallback_map,
+// if given.
 void ExpandOnce(const IncludePicker::IncludeMap& m,
-                vector<MappedInclude>* nodes) {
+                vector<MappedInclude>* nodes,
+                const IncludePicker::IncludeMap* fallback_map = nullptr) {
   vector<MappedInclude> nodes_and_children;
   set<string> seen_nodes_and_children;
   for (const MappedInclude& node : *nodes) {
@@ -1355,8 +1364,10 @@ void ExpandOnce(const IncludePicker::IncludeMap& m,
       nodes_and_children.push_back(node);
       seen_nodes_and_children.insert(node.quoted_include);
     }
-    if (const vector<MappedInclude>* children =
-        FindInMap(&m, node.quoted_include)) {
+    const vector<MappedInclude>* children = FindInMap(&m, node.quoted_include);
+    if (children == nullptr && fallback_map != nullptr)
+      children = FindInMap(fallback_map, node.quoted_include);
+    if (children) {
       for (const MappedInclude& child : *children) {
         if (!ContainsKey(seen_nodes_and_children, child.quoted_include)) {
           nodes_and_children.push_back(child);
@@ -1378,7 +1389,10 @@ enum TransitiveStatus { kUnused = 0, kCalculating, kDone };
 // results in a vector of all values seen.
 // NOTE: This function updates values seen in filename_map, but
 // does not invalidate any filename_map iterators.
+// Nodes that aren't keys of filename_map may be keys of closed_map, if
+// given, whose values are transitively closed already.
 void MakeNodeTransitive(IncludePicker::IncludeMap* filename_map,
+                        const IncludePicker::IncludeMap* closed_map,
                         map<string, TransitiveStatus>* seen_nodes,
                         vector<string>* node_stack,  // used for debugging
                         const string& key) {
@@ -1412,7 +1426,7 @@ void MakeNodeTransitive(IncludePicker::IncludeMap* filename_map,
   (*seen_nodes)[key] = kCalculating;
   for (const MappedInclude& child : node->second) {
     node_stack->push_back(child.quoted_include);
-    MakeNodeTransitive(filename_map, seen_nodes, node_stack,
+    MakeNodeTransitive(filename_map, closed_map, seen_nodes, node_stack,
                        child.quoted_include);
     node_stack->pop_back();
   }
@@ -1422,17 +1436,66 @@ void MakeNodeTransitive(IncludePicker::IncludeMap* filename_map,
   // children.  This routine replaces our value with this closure,
   // by replacing each of our values with its values.  Since our
   // values have already been made transitive, that is a closure.
-  ExpandOnce(*filename_map, &node->second);
+  ExpandOnce(*filename_map, &node->second, closed_map);
 }
 
 // Updates the values in filename_map based on its transitive mappings.
-void MakeMapTransitive(IncludePicker::IncludeMap* filename_map) {
+// If closed_map is given, the keys of filename_map may map to its keys,
+// whose values are taken to be closed already: they are used as they are,
+// and not recomputed.
+void MakeMapTransitive(IncludePicker::IncludeMap* filename_map,
+                       const IncludePicker::IncludeMap* closed_map = nullptr) {
   // Insert keys of filename_map here once we know their value is
   // the complete transitive closure.
   map<string, TransitiveStatus> seen_nodes;
   vector<string> node_stack;
   for (const IncludePicker::IncludeMap::value_type& includes : *filename_map)
-    MakeNodeTransitive(filename_map, &seen_nodes, &node_stack, includes.first);
+    MakeNodeTransitive(filename_map, closed_map, &seen_nodes, &node_stack,
+                       includes.first);
+}
+
+// Returns a map from each quoted include among the values of m to the
+// keys that map to it.
+map<string, vector<string>> IndexKeysByValue(
+    const IncludePicker::IncludeMap& m) {
+  map<string, vector<string>> keys_by_value;
+  for (const IncludePicker::IncludeMap::value_type& item : m) {
+    for (const MappedInclude& value : item.second)
+      keys_by_value[value.quoted_include].push_back(item.first);
+  }
+  return keys_by_value;
+}
+
+// Fills finalized_map with the symbols whose expanded values are affected
+// by own_map, or by the filepath keys in affected_keys, which are the ones
+// finalized_filepath_map holds.  A symbol's values are those from
+// snapshot_map followed by those from own_map, expanded through the
+// finalized filepath map, or closed_filepath_map for unaffected keys.
+void FinalizeSymbolMap(
+    const IncludePicker::IncludeMap& snapshot_map,
+    const map<string, vector<string>>& symbols_by_value,
+    const IncludePicker::IncludeMap& own_map,
+    const set<string>& affected_keys,
+    const IncludePicker::IncludeMap& finalized_filepath_map,
+    const IncludePicker::IncludeMap& closed_filepath_map,
+    IncludePicker::IncludeMap* finalized_map) {
+  set<string> affected_symbols;
+  for (const IncludePicker::IncludeMap::value_type& item : own_map)
+    affected_symbols.insert(item.first);
+  for (const string& key : affected_keys) {
+    if (const vector<string>* symbols = FindInMap(&symbols_by_value, key))
+      InsertAllInto(*symbols, &affected_symbols);
+  }
+
+  for (const string& symbol : affected_symbols) {
+    vector<MappedInclude>& values = (*finalized_map)[symbol];
+    if (const vector<MappedInclude>* snapshot_values =
+            FindInMap(&snapshot_map, symbol))
+      values = *snapshot_values;
+    if (const vector<MappedInclude>* own_values = FindInMap(&own_map, symbol))
+      Extend(&values, *own_values);
+    ExpandOnce(finalized_filepath_map, &values, &closed_filepath_map);
+  }
 }
 
 // Get a scalar value from a YAML node.
@@ -1660,12 +1723,107 @@ bool MappedInclude::HasAbsoluteQuotedInclude() const {
   return IsAbsolutePath(path);
 }
 
+IncludePicker::IncludePicker(shared_ptr<const MappingSnapshot> snapshot)
+    : snapshot_(std::move(snapshot)),
+      has_called_finalize_added_include_lines_(false),
+      regex_dialect(snapshot_->regex_dialect) {
+}
+
 IncludePicker::IncludePicker(RegexDialect regex_dialect,
                              CStdLib cstdlib,
                              CXXStdLib cxxstdlib)
-    : has_called_finalize_added_include_lines_(false),
-      regex_dialect(regex_dialect) {
-  AddInternalMappings(cstdlib, cxxstdlib);
+    : IncludePicker(BuildMappingSnapshot(regex_dialect, cstdlib, cxxstdlib,
+                                         vector<string>())) {
+}
+
+// Returns a hash of the contents of a mapping file, to notice edits.
+static size_t HashMappingFile(const MemoryBuffer& buffer) {
+  return llvm::hash_value(buffer.getBuffer());
+}
+
+// Returns true if any mapping file that snapshot was built from has been
+// edited, created or removed since.
+static bool MappingFilesChanged(
+    const IncludePicker::MappingSnapshot& snapshot) {
+  for (const auto& [path, hash] : snapshot.mappings.mapping_file_hashes) {
+    llvm::ErrorOr<unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(path);
+    optional<size_t> current_hash;
+    if (buffer)
+      current_hash = HashMappingFile(**buffer);
+    if (current_hash != hash)
+      return true;
+  }
+  return false;
+}
+
+shared_ptr<const IncludePicker::MappingSnapshot>
+IncludePicker::GetMappingSnapshot(RegexDialect regex_dialect,
+                                  CStdLib cstdlib,
+                                  CXXStdLib cxxstdlib,
+                                  const vector<string>& mapping_files) {
+  // Besides the arguments, the internal mappings depend on --use_c_headers.
+  // The mutex is held while building, so that concurrent callers asking for
+  // the same snapshot wait for it instead of building their own.  Mapping
+  // files are re-read to check for edits, as a process running IWYU on
+  // many translation units, e.g. via RunIwyu, may outlive them; that's
+  // cheap next to parsing them.
+  typedef tuple<RegexDialect, CStdLib, CXXStdLib, bool, vector<string>>
+      SnapshotKey;
+  static std::mutex snapshot_mutex;
+  static map<SnapshotKey, shared_ptr<const MappingSnapshot>> snapshots;
+
+  std::lock_guard<std::mutex> lock(snapshot_mutex);
+  shared_ptr<const MappingSnapshot>& snapshot =
+      snapshots[SnapshotKey(regex_dialect, cstdlib, cxxstdlib,
+                            GlobalFlags().use_c_headers, mapping_files)];
+  if (snapshot == nullptr || MappingFilesChanged(*snapshot)) {
+    snapshot = BuildMappingSnapshot(regex_dialect, cstdlib, cxxstdlib,
+                                    mapping_files);
+  }
+  return snapshot;
+}
+
+shared_ptr<const IncludePicker::MappingSnapshot>
+IncludePicker::BuildMappingSnapshot(RegexDialect regex_dialect,
+                                    CStdLib cstdlib,
+                                    CXXStdLib cxxstdlib,
+                                    const vector<string>& mapping_files) {
+  // Collect the mappings in an include-picker on top of an empty snapshot,
+  // then move them over to the new one.
+  auto empty_snapshot = std::make_shared<MappingSnapshot>();
+  empty_snapshot->regex_dialect = regex_dialect;
+  IncludePicker builder(empty_snapshot);
+  builder.AddInternalMappings(cstdlib, cxxstdlib);
+  for (const string& mapping_file : mapping_files) {
+    builder.AddMappingsFromFile(mapping_file);
+  }
+
+  auto snapshot = std::make_shared<MappingSnapshot>();
+  snapshot->regex_dialect = regex_dialect;
+  snapshot->mappings = std::move(builder.mappings_);
+
+  // Finalize the mappings as far as possible without knowing the includes
+  // of a translation unit.  Regex keys are left alone for ExpandRegexes.
+  snapshot->closed_filepath_include_map =
+      snapshot->mappings.filepath_include_map;
+  MakeMapTransitive(&snapshot->closed_filepath_include_map);
+  snapshot->closed_symbol_include_map = snapshot->mappings.symbol_include_map;
+  for (IncludeMap::value_type& symbol_include :
+       snapshot->closed_symbol_include_map)
+    ExpandOnce(snapshot->closed_filepath_include_map, &symbol_include.second);
+  snapshot->closed_fwd_decl_symbol_map = snapshot->mappings.fwd_decl_symbol_map;
+  for (IncludeMap::value_type& symbol_include :
+       snapshot->closed_fwd_decl_symbol_map)
+    ExpandOnce(snapshot->closed_filepath_include_map, &symbol_include.second);
+
+  snapshot->filepath_keys_by_value =
+      IndexKeysByValue(snapshot->closed_filepath_include_map);
+  snapshot->symbols_by_value =
+      IndexKeysByValue(snapshot->mappings.symbol_include_map);
+  snapshot->fwd_decl_symbols_by_value =
+      IndexKeysByValue(snapshot->mappings.fwd_decl_symbol_map);
+  return snapshot;
 }
 
 void IncludePicker::AddInternalMappings(CStdLib cstdlib, CXXStdLib cxxstdlib) {
@@ -1741,24 +1899,39 @@ void IncludePicker::AddInternalMappings(CStdLib cstdlib, CXXStdLib cxxstdlib) {
   // <cname> are suggested instead of <name.h>.
   if (cxxstdlib != CXXStdLib::None && !GlobalFlags().use_c_headers) {
     for (const IncludeMapEntry& entry : stdlib_c_include_map)
-      include_visibility_map_.at(entry.map_from) = IncludeVisibility::kPrivate;
+      mappings_.include_visibility_map.at(entry.map_from) =
+          IncludeVisibility::kPrivate;
   }
 }
 
-void IncludePicker::MarkVisibility(VisibilityMap* map,
+void IncludePicker::MarkVisibility(VisibilityMap Mappings::*map,
                                    const string& key,
                                    IncludeVisibility visibility) {
   CHECK_(!has_called_finalize_added_include_lines_ && "Can't mutate anymore");
 
-  // insert() leaves any old value alone, and only inserts if the key is new.
-  map->insert(make_pair(key, visibility));
-  CHECK_((*map)[key] == visibility)
+  // Keys already in the snapshot are not repeated in mappings_, so that
+  // each key has a single visibility to check against.
+  const IncludeVisibility* old_visibility =
+      FindInMap(&(snapshot_->mappings.*map), key);
+  if (old_visibility == nullptr) {
+    // insert() leaves any old value alone, and only inserts if the key is new.
+    old_visibility =
+        &(mappings_.*map).insert(make_pair(key, visibility)).first->second;
+  }
+  CHECK_(*old_visibility == visibility)
       << " Same file seen with two different visibilities: "
       << key
-      << " Old vis: " << (*map)[key]
+      << " Old vis: " << *old_visibility
       << " New vis: " << visibility;
 }
 
+const IncludeVisibility* IncludePicker::FindVisibility(
+    VisibilityMap Mappings::*map, const string& key) const {
+  if (const IncludeVisibility* visibility = FindInMap(&(mappings_.*map), key))
+    return visibility;
+  return FindInMap(&(snapshot_->mappings.*map), key);
+}
+
 // AddDirectInclude lets us use some hard-coded rules to add filepath
 // mappings at runtime.  It includes, for instance, mappings from
 // 'project/internal/foo.h' to 'project/public/foo_public.h' in google
@@ -1775,9 +1948,13 @@ void IncludePicker::AddDirectInclude(const string& includer_filepath,
   const string quoted_includee = ConvertToQuotedInclude(includee_filepath);
   MappedInclude mapped_includer(quoted_includer, includer_filepath);
 
-  quoted_includes_to_quoted_includers_[quoted_includee].insert(quoted_includer);
-  const pair<string, string> key(includer_filepath, includee_filepath);
-  includer_and_includee_to_include_as_written_[key] = quoted_include_as_written;
+  quoted_includes_to_quoted_includers_[interned_paths_.Intern(quoted_includee)]
+      .insert(interned_paths_.Intern(quoted_includer));
+  const pair<InternedString, InternedString> key(
+      interned_paths_.Intern(includer_filepath),
+      interned_paths_.Intern(includee_filepath));
+  includer_and_includee_to_include_as_written_[key] =
+      interned_paths_.Intern(quoted_include_as_written);
 
   // Mark the clang fake-file "<built-in>" as private, so we never try
   // to map anything to it.
@@ -1818,7 +1995,7 @@ void IncludePicker::AddMapping(const string& map_from,
   CHECK_(!has_called_finalize_added_include_lines_ && "Can't mutate anymore");
   CHECK_(IsQuotedFilepathPattern(map_from)
          && "All map keys must be quoted filepaths or @ followed by regex");
-  filepath_include_map_[map_from].push_back(map_to);
+  mappings_.filepath_include_map[map_from].push_back(map_to);
 }
 
 void IncludePicker::AddIncludeMapping(const string& map_from,
@@ -1826,9 +2003,9 @@ void IncludePicker::AddIncludeMapping(const string& map_from,
                                       const MappedInclude& map_to,
                                       IncludeVisibility to_visibility) {
   AddMapping(map_from, map_to);
-  MarkVisibility(&include_visibility_map_, map_from, from_visibility);
-  MarkVisibility(&include_visibility_map_, map_to.quoted_include,
-                 to_visibility);
+  MarkVisibility(&Mappings::include_visibility_map, map_from, from_visibility);
+  MarkVisibility(&Mappings::include_visibility_map,
+                 map_to.quoted_include, to_visibility);
 }
 
 void IncludePicker::AddSymbolMapping(const string& map_from,
@@ -1836,13 +2013,13 @@ void IncludePicker::AddSymbolMapping(const string& map_from,
                                      const MappedInclude& map_to,
                                      IncludeVisibility to_visibility) {
   if (use_kind == UseKind::Full) {
-    symbol_include_map_[map_from].push_back(map_to);
+    mappings_.symbol_include_map[map_from].push_back(map_to);
   } else {
-    fwd_decl_symbol_map_[map_from].push_back(map_to);
+    mappings_.fwd_decl_symbol_map[map_from].push_back(map_to);
   }
 
-  MarkVisibility(&include_visibility_map_, map_to.quoted_include,
-                 to_visibility);
+  MarkVisibility(&Mappings::include_visibility_map,
+                 map_to.quoted_include, to_visibility);
 }
 
 void IncludePicker::AddIncludeMappings(const IncludeMapEntry* entries,
@@ -1866,7 +2043,7 @@ void IncludePicker::AddSymbolMappings(const SymbolMapEntry* entries,
 void IncludePicker::AddPublicIncludes(const char** includes, size_t count) {
   for (size_t i = 0; i < count; ++i) {
     const char* include = includes[i];
-    MarkVisibility(&include_visibility_map_, include, kPublic);
+    MarkVisibility(&Mappings::include_visibility_map, include, kPublic);
   }
 }
 
@@ -1875,12 +2052,13 @@ void IncludePicker::MarkIncludeAsPrivate(
   CHECK_(!has_called_finalize_added_include_lines_ && "Can't mutate anymore");
   CHECK_(IsQuotedFilepathPattern(quoted_filepath_pattern)
          && "MIAP takes a quoted filepath pattern");
-  MarkVisibility(&include_visibility_map_, quoted_filepath_pattern, kPrivate);
+  MarkVisibility(&Mappings::include_visibility_map, quoted_filepath_pattern,
+                 kPrivate);
 }
 
 void IncludePicker::MarkPathAsPrivate(const string& path) {
   CHECK_(!has_called_finalize_added_include_lines_ && "Can't mutate anymore");
-  MarkVisibility(&path_visibility_map_, path, kPrivate);
+  MarkVisibility(&Mappings::path_visibility_map, path, kPrivate);
 }
 
 void IncludePicker::AddFriendRegex(const string& includee_filepath,
@@ -1915,35 +2093,45 @@ bool ContainsQuotedInclude(
 
 }  // anonymous namespace
 
-// Expands the regex keys in filepath_include_map_ and
+// Expands the regex keys in the filepath include maps and
 // friend_to_headers_map_ by matching them against all source files
 // seen by iwyu.  For each include that matches the regex, we add it
 // to the map by copying the regex entry and replacing the key with
 // the seen #include.
 void IncludePicker::ExpandRegexes() {
-  // First, get the regex keys.
-  const vector<string> filepath_include_map_regex_keys =
-      ExtractKeysMarkedAsRegexes(filepath_include_map_);
+  // First, get the regex keys, along with what they map to.  The values
+  // from the snapshot come first, since they were added first.
+  IncludeMap filepath_include_map_regexes;
+  for (const IncludeMap* m : {&snapshot_->mappings.filepath_include_map,
+                              &mappings_.filepath_include_map}) {
+    for (const string& regex_key : ExtractKeysMarkedAsRegexes(*m))
+      Extend(&filepath_include_map_regexes[regex_key], m->at(regex_key));
+  }
   const vector<string> friend_to_headers_map_regex_keys =
       ExtractKeysMarkedAsRegexes(friend_to_headers_map_);
 
   // Then, go through all #includes to see if they match the regexes,
   // discarding the identity mappings.  TODO(wan): to improve
   // performance, don't construct more than one Regex object for each
-  // element in the above vectors.
+  // element in the above vectors.  The #includes are in no particular
+  // order, but each one only adds mappings for itself.
   for (const auto& incmap : quoted_includes_to_quoted_includers_) {
-    const string& hdr = incmap.first;
-    for (const string& regex_key : filepath_include_map_regex_keys) {
+    const string& hdr = incmap.first.str();
+    for (const auto& regex_mapping : filepath_include_map_regexes) {
+      const string& regex_key = regex_mapping.first;
       const string regex = regex_key.substr(1);
-      const vector<MappedInclude>& map_to = filepath_include_map_[regex_key];
+      const vector<MappedInclude>& map_to = regex_mapping.second;
       if (RegexMatch(regex_dialect, hdr, regex) &&
           !ContainsQuotedInclude(map_to, hdr)) {
         for (const MappedInclude& target : map_to) {
-          filepath_include_map_[hdr].push_back(MappedInclude(
+          mappings_.filepath_include_map[hdr].push_back(MappedInclude(
               RegexReplace(regex_dialect, hdr, regex, target.quoted_include)));
         }
-        MarkVisibility(&include_visibility_map_, hdr,
-                       include_visibility_map_[regex_key]);
+        const IncludeVisibility* regex_visibility =
+            FindVisibility(&Mappings::include_visibility_map, regex_key);
+        MarkVisibility(&Mappings::include_visibility_map, hdr,
+                       regex_visibility ? *regex_visibility
+                                        : kUnusedVisibility);
       }
     }
     for (const string& regex_key : friend_to_headers_map_regex_keys) {
@@ -1961,28 +2149,69 @@ void IncludePicker::ExpandRegexes() {
 // the mapping-keys, since we have the full list of #includes to
 // match them again.  We also transitively-close the maps.
 void IncludePicker::FinalizeAddedIncludes() {
+  llvm::TimeTraceScope trace_scope("IWYU FinalizeAddedIncludes");
   CHECK_(!has_called_finalize_added_include_lines_ && "Can't call FAI twice");
 
   // The map keys may be regular expressions.
   // Match those to seen #includes now.
   ExpandRegexes();
 
+  // The snapshot's mappings are finalized already, so only the keys that
+  // our own mappings affect need finalizing here: the ones we add mappings
+  // for, and the ones in the snapshot that (transitively) map to those.
+  // They start out with the snapshot's values, followed by ours.
+  set<string> affected_keys;
+  for (const IncludeMap::value_type& item : mappings_.filepath_include_map) {
+    affected_keys.insert(item.first);
+    if (const vector<string>* keys =
+            FindInMap(&snapshot_->filepath_keys_by_value, item.first))
+      InsertAllInto(*keys, &affected_keys);
+  }
+  for (const string& key : affected_keys) {
+    vector<MappedInclude>& values = finalized_filepath_include_map_[key];
+    if (const vector<MappedInclude>* snapshot_values =
+            FindInMap(&snapshot_->mappings.filepath_include_map, key))
+      values = *snapshot_values;
+    if (const vector<MappedInclude>* own_values =
+            FindInMap(&mappings_.filepath_include_map, key))
+      Extend(&values, *own_values);
+  }
+
   // If a.h maps to b.h maps to c.h, we'd like an entry from a.h to c.h too.
-  MakeMapTransitive(&filepath_include_map_);
-  // Now that filepath_include_map_ is transitively closed, it's an
+  // Keys that aren't affected have their closure in the snapshot.
+  MakeMapTransitive(&finalized_filepath_include_map_,
+                    &snapshot_->closed_filepath_include_map);
+  // Now that the filepath map is transitively closed, it's an
   // easy task to get the values of symbol maps closed too.
-  for (IncludeMap::value_type& symbol_include : symbol_include_map_)
-    ExpandOnce(filepath_include_map_, &symbol_include.second);
-  for (IncludeMap::value_type& symbol_include : fwd_decl_symbol_map_)
-    ExpandOnce(filepath_include_map_, &symbol_include.second);
+  FinalizeSymbolMap(snapshot_->mappings.symbol_include_map,
+                    snapshot_->symbols_by_value,
+                    mappings_.symbol_include_map, affected_keys,
+                    finalized_filepath_include_map_,
+                    snapshot_->closed_filepath_include_map,
+                    &finalized_symbol_include_map_);
+  FinalizeSymbolMap(snapshot_->mappings.fwd_decl_symbol_map,
+                    snapshot_->fwd_decl_symbols_by_value,
+                    mappings_.fwd_decl_symbol_map, affected_keys,
+                    finalized_filepath_include_map_,
+                    snapshot_->closed_filepath_include_map,
+                    &finalized_fwd_decl_symbol_map_);
 
   has_called_finalize_added_include_lines_ = true;
 
   // Print some mapping statistics.
   if (ShouldPrint(9)) {
-    PrintMappings(filepath_include_map_, "filepath_include_map_");
-    PrintMappings(symbol_include_map_, "symbol_include_map_");
-    PrintMappings(fwd_decl_symbol_map_, "fwd_decl_symbol_map_");
+    PrintMappings(snapshot_->closed_filepath_include_map,
+                  "shared filepath_include_map");
+    PrintMappings(snapshot_->closed_symbol_include_map,
+                  "shared symbol_include_map");
+    PrintMappings(snapshot_->closed_fwd_decl_symbol_map,
+                  "shared fwd_decl_symbol_map");
+    PrintMappings(finalized_filepath_include_map_,
+                  "finalized_filepath_include_map_");
+    PrintMappings(finalized_symbol_include_map_,
+                  "finalized_symbol_include_map_");
+    PrintMappings(finalized_fwd_decl_symbol_map_,
+                  "finalized_fwd_decl_symbol_map_");
   }
 }
 
@@ -1993,10 +2222,13 @@ void IncludePicker::FinalizeAddedIncludes() {
 // the map, we insert the key as the first of the returned values,
 // this is an implicit "self-map."
 vector<MappedInclude> IncludePicker::GetPublicValues(
-    const IncludePicker::IncludeMap& m, const string& key) const {
+    const IncludePicker::IncludeMap& own_map,
+    const IncludePicker::IncludeMap& shared_map, const string& key) const {
   CHECK_(!StartsWith(key, "@"));
   vector<MappedInclude> retval;
-  const vector<MappedInclude>* values = FindInMap(&m, key);
+  const vector<MappedInclude>* values = FindInMap(&own_map, key);
+  if (values == nullptr)
+    values = FindInMap(&shared_map, key);
   if (!values || values->empty())
     return retval;
 
@@ -2010,11 +2242,16 @@ vector<MappedInclude> IncludePicker::GetPublicValues(
 
 string IncludePicker::MaybeGetIncludeNameAsWritten(
     const string& includer_filepath, const string& includee_filepath) const {
-  const pair<string, string> key(includer_filepath, includee_filepath);
-  // I want to use GetOrDefault here, but it has trouble deducing tpl args.
-  const string* value = FindInMap(&includer_and_includee_to_include_as_written_,
-                                  key);
-  return value ? *value : "";
+  // Paths that were never interned can't be in the map.
+  const optional<InternedString> includer =
+      interned_paths_.Find(includer_filepath);
+  const optional<InternedString> includee =
+      interned_paths_.Find(includee_filepath);
+  if (!includer || !includee)
+    return "";
+  return includer_and_includee_to_include_as_written_
+      .lookup(make_pair(*includer, *includee))
+      .str();
 }
 
 vector<string> IncludePicker::BestQuotedIncludesForIncluder(
@@ -2052,14 +2289,17 @@ vector<string> IncludePicker::BestQuotedIncludesForIncluder(
 vector<MappedInclude> IncludePicker::GetCandidateHeadersForSymbol(
     const string& symbol) const {
   CHECK_(has_called_finalize_added_include_lines_ && "Must finalize includes");
-  return GetPublicValues(symbol_include_map_, symbol);
+  return GetPublicValues(finalized_symbol_include_map_,
+                         snapshot_->closed_symbol_include_map, symbol);
 }
 
 vector<string> IncludePicker::GetCandidateHeadersForSymbolFwdDecl(
     const string& symbol, const string& including_filepath) const {
   CHECK_(has_called_finalize_added_include_lines_ && "Must finalize includes");
   return BestQuotedIncludesForIncluder(
-      GetPublicValues(fwd_decl_symbol_map_, symbol), including_filepath);
+      GetPublicValues(finalized_fwd_decl_symbol_map_,
+                      snapshot_->closed_fwd_decl_symbol_map, symbol),
+      including_filepath);
 }
 
 vector<string> IncludePicker::GetCandidateHeadersForSymbolUsedFrom(
@@ -2073,7 +2313,9 @@ vector<MappedInclude> IncludePicker::GetCandidateHeadersForFilepath(
   CHECK_(has_called_finalize_added_include_lines_ && "Must finalize includes");
   string absolute_quoted_header = ConvertToQuotedInclude(filepath);
   vector<MappedInclude> retval =
-      GetPublicValues(filepath_include_map_, absolute_quoted_header);
+      GetPublicValues(finalized_filepath_include_map_,
+                      snapshot_->closed_filepath_include_map,
+                      absolute_quoted_header);
 
   // We also need to consider the header itself.  Make that an option if it's
   // public or there's no other option.
@@ -2135,7 +2377,11 @@ bool IncludePicker::HasMapping(const string& map_from_filepath,
   const string quoted_to = ConvertToQuotedInclude(map_to_filepath);
   // We can't use GetCandidateHeadersForFilepath since includer might be private
   const vector<MappedInclude>* all_mappers =
-      FindInMap(&filepath_include_map_, quoted_from);
+      FindInMap(&finalized_filepath_include_map_, quoted_from);
+  if (all_mappers == nullptr) {
+    all_mappers =
+        FindInMap(&snapshot_->closed_filepath_include_map, quoted_from);
+  }
   if (all_mappers) {
     if (ContainsQuotedInclude(*all_mappers, quoted_to)) {
       return true;
@@ -2158,6 +2404,27 @@ void IncludePicker::AddMappingsFromFile(const string& filename) {
   return AddMappingsFromFile(filename, default_search_path);
 }
 
+set<string> IncludePicker::GetFullUseTemplates() const {
+  return Union(snapshot_->mappings.full_use_templates,
+               mappings_.full_use_templates);
+}
+
+map<string, size_t> IncludePicker::GetPrivateWrapperTemplates() const {
+  map<string, size_t> templates = mappings_.private_wrapper_templates;
+  templates.insert(snapshot_->mappings.private_wrapper_templates.begin(),
+                   snapshot_->mappings.private_wrapper_templates.end());
+  return templates;
+}
+
+set<string> IncludePicker::GetMappingFiles() const {
+  set<string> mapping_files;
+  for (const Mappings* mappings : {&snapshot_->mappings, &mappings_}) {
+    for (const auto& [path, hash] : mappings->mapping_file_hashes)
+      mapping_files.insert(path);
+  }
+  return mapping_files;
+}
+
 vector<string> IncludePicker::GetMappedPublicHeaders(
     const string& symbol_name,
     const string& use_path,
@@ -2170,31 +2437,52 @@ vector<string> IncludePicker::GetMappedPublicHeaders(
   return GetCandidateHeadersForFilepathIncludedFrom(decl_filepath, use_path);
 }
 
+vector<MappedInclude> IncludePicker::GetCandidateHeadersForDecl(
+    const NamedDecl* decl) const {
+  {
+    std::lock_guard<std::mutex> lock(decl_symbol_headers_mutex_);
+    auto it = decl_symbol_headers_.find(decl);
+    if (it != decl_symbol_headers_.end())
+      return it->second;
+  }
+
+  vector<MappedInclude> symbol_headers;
+  if (decl->getLangOpts().CPlusPlus) {
+    symbol_headers = GetCandidateHeadersForSymbol(
+        GetWrittenQualifiedNameAsString(decl, /*with_fn_args=*/true));
+  }
+  // If there is no entry with explicitly written function argument types, try
+  // to fall back to the bare function name.
+  if (symbol_headers.empty()) {
+    symbol_headers = GetCandidateHeadersForSymbol(
+        GetWrittenQualifiedNameAsString(decl, /*with_fn_args=*/false));
+  }
+
+  // Returns a copy, as DenseMap moves its values when it grows.  That's
+  // cheap for the common empty vector.
+  std::lock_guard<std::mutex> lock(decl_symbol_headers_mutex_);
+  decl_symbol_headers_.try_emplace(decl, symbol_headers);
+  return symbol_headers;
+}
+
 vector<string> IncludePicker::GetMappedPublicHeaders(
     const NamedDecl* decl,
     const string& use_path,
     const string& decl_filepath) const {
   // If decl has a special mapping, use it, otherwise map its file.
-  vector<string> symbol_headers;
-  if (decl->getLangOpts().CPlusPlus) {
-    symbol_headers = GetCandidateHeadersForSymbolUsedFrom(
-        GetWrittenQualifiedNameAsString(decl, /*with_fn_args=*/true), use_path);
-    if (!symbol_headers.empty())
-      return symbol_headers;
-  }
-  // If there is no entry with explicitly written function argument types, try
-  // to fall back to the bare function name.
-  symbol_headers = GetCandidateHeadersForSymbolUsedFrom(
-      GetWrittenQualifiedNameAsString(decl, /*with_fn_args=*/false), use_path);
+  const vector<MappedInclude> symbol_headers =
+      GetCandidateHeadersForDecl(decl);
   if (!symbol_headers.empty())
-    return symbol_headers;
+    return BestQuotedIncludesForIncluder(symbol_headers, use_path);
   return GetCandidateHeadersForFilepathIncludedFrom(decl_filepath, use_path);
 }
 
 vector<string> IncludePicker::GetMappedPublicHeaders(
     const string& quoted_header, const string& use_path) const {
   return BestQuotedIncludesForIncluder(
-      GetPublicValues(filepath_include_map_, quoted_header), use_path);
+      GetPublicValues(finalized_filepath_include_map_,
+                      snapshot_->closed_filepath_include_map, quoted_header),
+      use_path);
 }
 
 // Parses a YAML/JSON file containing mapping directives of various types:
@@ -2202,6 +2490,10 @@ vector<string> IncludePicker::GetMappedPublicHeaders(
 //  include  - private quoted include -> public quoted include
 //  ref      - include mechanism for mapping files, to allow project-specific
 //             groupings
+//  full_use_template - class template whose instantiation requires full
+//             use of all template arguments
+//  private_wrapper_template - class template whose specializations stand
+//             for one of their type arguments
 // This private implementation method is recursive and builds the search path
 // incrementally.
 void IncludePicker::AddMappingsFromFile(const string& filename,
@@ -2213,8 +2505,11 @@ void IncludePicker::AddMappingsFromFile(const string& filename,
   if (std::error_code error = bufferOrError.getError()) {
     VERRS(0) << "Cannot open mapping file '" << absolute_path
              << "': " << error.message() << ".\n";
+    mappings_.mapping_file_hashes[absolute_path] = std::nullopt;
     return;
   }
+  mappings_.mapping_file_hashes[absolute_path] =
+      HashMappingFile(*bufferOrError.get());
 
   VERRS(5) << "Adding mappings from file '" << absolute_path << "'.\n";
 
@@ -2346,6 +2641,27 @@ void IncludePicker::AddMappingsFromFile(const string& filename,
 
         // Recurse.
         AddMappingsFromFile(ref_file, extended_search_path);
+      } else if (directive == "full_use_template") {
+        // Container template.
+        string template_name = GetScalarValue(mapping_item_node.getValue());
+        if (template_name.empty()) {
+          json_stream.printError(current_node,
+              "Full-use template expects a single qualified name value.");
+          return;
+        }
+        mappings_.full_use_templates.insert(template_name);
+      } else if (directive == "private_wrapper_template") {
+        // Wrapper template and the index of its wrapped type argument.
+        vector<string> mapping = GetSequenceValue(mapping_item_node.getValue());
+        unsigned type_arg_idx = 0;
+        if (mapping.size() != 2 || mapping[0].empty() ||
+            StringRef(mapping[1]).getAsInteger(10, type_arg_idx)) {
+          json_stream.printError(current_node,
+              "Private wrapper template expects a value on the form "
+              "'[qualified name, type argument index]'.");
+          return;
+        }
+        mappings_.private_wrapper_templates[mapping[0]] = type_arg_idx;
       } else {
         json_stream.printError(current_node,
             "Unknown directive '" + directive + "'.");
@@ -2368,11 +2684,13 @@ IncludeVisibility IncludePicker::ParseVisibility(
 IncludeVisibility IncludePicker::GetVisibility(
     const MappedInclude& include, IncludeVisibility default_value) const {
   const IncludeVisibility* include_visibility =
-    FindInMap(&include_visibility_map_, include.quoted_include);
+    FindVisibility(&Mappings::include_visibility_map, include.quoted_include);
   if (include_visibility) {
     return *include_visibility;
   }
-  return GetOrDefault(path_visibility_map_, include.path, default_value);
+  const IncludeVisibility* path_visibility =
+      FindVisibility(&Mappings::path_visibility_map, include.path);
+  return path_visibility ? *path_visibility : default_value;
 }
 
 }  // namespace include_what_you_use
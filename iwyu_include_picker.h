@@ -46,12 +46,18 @@
 
 #include <cstddef>
 #include <map>                          // for map, map<>::value_compare
+#include <memory>                       // for shared_ptr
+#include <mutex>                        // for mutex
+#include <optional>
 #include <set>                          // for set
 #include <string>                       // for string
 #include <utility>                      // for pair
 #include <vector>                       // for vector
 
 #include "clang/Basic/FileEntry.h"
+#include "iwyu_string_util.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 
 namespace clang {
 class NamedDecl;
@@ -62,6 +68,7 @@ namespace include_what_you_use {
 using std::map;
 using std::pair;
 using std::set;
+using std::shared_ptr;
 using std::string;
 
 using std::vector;
@@ -103,6 +110,84 @@ class IncludePicker {
   // visibility of the respective files.
   typedef map<string, IncludeVisibility> VisibilityMap;
 
+  // Mappings as they are added, before regex expansion and transitive
+  // closure.
+  struct Mappings {
+    // From symbols to includes for full symbol uses.
+    IncludeMap symbol_include_map;
+    // From symbols to includes for uses that require only
+    // forward-declarations.
+    IncludeMap fwd_decl_symbol_map;
+
+    // From quoted filepath patterns to includes, where a pattern can be
+    // either a quoted filepath (e.g. "foo/bar.h" or <a/b.h>) or @
+    // followed by a regular expression for matching a quoted filepath
+    // (e.g. @"foo/.*").  If key-value pair (pattern, headers) is in
+    // this map, it means that any header in 'headers' can be used to
+    // get symbols exported by a header matching 'pattern'.
+    IncludeMap filepath_include_map;
+
+    // A map of all quoted-includes to whether they're public or private.
+    // Files whose visibility cannot be determined by this map nor the one
+    // below may be assumed public (see GetVisibility usage).
+    VisibilityMap include_visibility_map;
+
+    // A map of paths to whether they're public or private.
+    // Files whose visibility cannot be determined by this map nor the one
+    // above may be assumed public (see GetVisibility usage).
+    // The include_visibility_map takes priority over this one.
+    VisibilityMap path_visibility_map;
+
+    // Qualified names of templates from 'full_use_template' directives.
+    set<string> full_use_templates;
+
+    // Qualified names of templates from 'private_wrapper_template'
+    // directives, mapped to the index of their wrapped type argument.
+    map<string, size_t> private_wrapper_templates;
+
+    // The mapping files these were read from, including those referenced
+    // by other mapping files, by absolute path.  Each has a hash of its
+    // contents, or nullopt if it couldn't be read.
+    map<string, std::optional<size_t>> mapping_file_hashes;
+  };
+
+  // The internal mappings plus those read from mapping files.  These only
+  // depend on the command line, so they are built once and never modified
+  // afterwards, which lets any number of include-pickers, on any thread,
+  // share them.  Mappings added to an include-picker later on, e.g. from
+  // pragmas, go into the picker's own Mappings on top of the snapshot.
+  struct MappingSnapshot {
+    RegexDialect regex_dialect;
+    Mappings mappings;
+
+    // The mappings above finalized on their own: the filepath map
+    // transitively closed and the symbol maps expanded through it.
+    // Include-pickers only finalize the keys their own mappings affect,
+    // and use these for all others.
+    IncludeMap closed_filepath_include_map;
+    IncludeMap closed_symbol_include_map;
+    IncludeMap closed_fwd_decl_symbol_map;
+
+    // Reverse indexes for finding the affected keys: from each quoted
+    // include to the keys of closed_filepath_include_map that map to it,
+    // and to the symbols that the symbol maps above map to it as added.
+    map<string, vector<string>> filepath_keys_by_value;
+    map<string, vector<string>> symbols_by_value;
+    map<string, vector<string>> fwd_decl_symbols_by_value;
+  };
+
+  // Returns the snapshot of the internal mappings for the given standard
+  // libraries, plus the mappings from mapping_files.  Snapshots are cached
+  // so that all callers asking for the same mappings share one, until one
+  // of the mapping files changes.  This is thread-safe.
+  static shared_ptr<const MappingSnapshot> GetMappingSnapshot(
+      RegexDialect regex_dialect, CStdLib cstdlib, CXXStdLib cxxstdlib,
+      const vector<string>& mapping_files);
+
+  explicit IncludePicker(shared_ptr<const MappingSnapshot> snapshot);
+
+  // Creates an include-picker with a snapshot of its own, holding just the
+  // internal mappings.
   IncludePicker(RegexDialect regex_dialect, CStdLib cstdlib,
                 CXXStdLib cxxstdlib);
 
@@ -137,7 +222,8 @@ class IncludePicker {
                       const string& quoted_friend_regex);
 
   // Call this after iwyu preprocessing is done.  No more calls to
-  // AddDirectInclude() or AddMapping() are allowed after this.
+  // AddDirectInclude() or AddMapping() are allowed after this, and
+  // all const member functions may then be called concurrently.
   void FinalizeAddedIncludes();
 
   // ----- Include-picking API
@@ -196,6 +282,22 @@ class IncludePicker {
   // Parses a YAML/JSON file containing mapping directives of various types.
   void AddMappingsFromFile(const string& filename);
 
+  // Returns the qualified names of the class templates added with the
+  // 'full_use_template' mapping directive: their instantiation requires
+  // full use of all template arguments.
+  set<string> GetFullUseTemplates() const;
+
+  // Returns the class templates added with the 'private_wrapper_template'
+  // mapping directive, by qualified name: their specializations wrap the
+  // type argument at the mapped-to index, and uses of them should be
+  // attributed to that type.
+  map<string, size_t> GetPrivateWrapperTemplates() const;
+
+  // Returns the absolute paths of the mapping files the mappings were read
+  // from, including those referenced by other mapping files and those that
+  // couldn't be read.
+  set<string> GetMappingFiles() const;
+
   // Returns the headers which the symbol is mapped to. If none, returns
   // the headers which decl_filepath is mapped to.
   vector<string> GetMappedPublicHeaders(const string& symbol_name,
@@ -209,6 +311,16 @@ class IncludePicker {
                                         const string& use_path) const;
 
  private:
+  // Returns the symbol mapping for decl, or an empty vector if it has
+  // none.  Memoized, since it's asked for every use of the decl.
+  vector<MappedInclude> GetCandidateHeadersForDecl(
+      const clang::NamedDecl* decl) const;
+
+  // Builds a new snapshot from the internal mappings and mapping_files.
+  static shared_ptr<const MappingSnapshot> BuildMappingSnapshot(
+      RegexDialect regex_dialect, CStdLib cstdlib, CXXStdLib cxxstdlib,
+      const vector<string>& mapping_files);
+
   // Private implementation of mapping file parser, which takes
   // mapping file search path to allow recursion that builds up
   // search path incrementally.
@@ -238,15 +350,21 @@ class IncludePicker {
 
   void AddPublicIncludes(const char** includes, size_t count);
 
-  // Expands the regex keys in filepath_include_map_ and
+  // Expands the regex keys in the filepath include maps and
   // friend_to_headers_map_ by matching them against all source files
   // seen by iwyu.
   void ExpandRegexes();
 
-  // Adds an entry to the given VisibilityMap, with error checking.
-  void MarkVisibility(VisibilityMap* map, const string& key,
+  // Adds an entry to the given VisibilityMap of mappings_, with error
+  // checking against both it and the one of the snapshot.
+  void MarkVisibility(VisibilityMap Mappings::*map, const string& key,
                       IncludeVisibility visibility);
 
+  // Returns the visibility of key in the given VisibilityMap of mappings_
+  // or, failing that, of the snapshot.  Returns null if neither has it.
+  const IncludeVisibility* FindVisibility(VisibilityMap Mappings::*map,
+                                          const string& key) const;
+
   // Parse visibility from a string. Returns kUnusedVisibility if
   // string is not recognized.
   IncludeVisibility ParseVisibility(const string& visibility) const;
@@ -258,9 +376,10 @@ class IncludePicker {
       IncludeVisibility default_value = kUnusedVisibility) const;
 
   // For the given key, return the vector of values associated with
-  // that key, or an empty vector if the key does not exist in the
-  // map, filtering out private files.
-  vector<MappedInclude> GetPublicValues(const IncludeMap& m,
+  // that key in own_map or, failing that, in shared_map, or an empty
+  // vector if the key exists in neither, filtering out private files.
+  vector<MappedInclude> GetPublicValues(const IncludeMap& own_map,
+                                        const IncludeMap& shared_map,
                                         const string& key) const;
 
   // Given an includer-pathname and includee-pathname, return the
@@ -274,39 +393,36 @@ class IncludePicker {
   vector<string> BestQuotedIncludesForIncluder(
       const vector<MappedInclude>&, const string& including_filepath) const;
 
-  // From symbols to includes for full symbol uses.
-  IncludeMap symbol_include_map_;
-  // From symbols to includes for uses that require only forward-declarations.
-  IncludeMap fwd_decl_symbol_map_;
-
-  // From quoted filepath patterns to includes, where a pattern can be
-  // either a quoted filepath (e.g. "foo/bar.h" or <a/b.h>) or @
-  // followed by a regular expression for matching a quoted filepath
-  // (e.g. @"foo/.*").  If key-value pair (pattern, headers) is in
-  // this map, it means that any header in 'headers' can be used to
-  // get symbols exported by a header matching 'pattern'.
-  IncludeMap filepath_include_map_;
-
-  // A map of all quoted-includes to whether they're public or private.
-  // Files whose visibility cannot be determined by this map nor the one
-  // below may be assumed public (see GetVisibility usage).
-  VisibilityMap include_visibility_map_;
-
-  // A map of paths to whether they're public or private.
-  // Files whose visibility cannot be determined by this map nor the one
-  // above may be assumed public (see GetVisibility usage).
-  // The include_visibility_map_ takes priority over this one.
-  VisibilityMap path_visibility_map_;
+  // Mappings shared with other include-pickers.
+  shared_ptr<const MappingSnapshot> snapshot_;
+
+  // Mappings added to this include-picker, on top of those in snapshot_.
+  // A visibility key is only added here if the snapshot lacks it.
+  Mappings mappings_;
+
+  // The finalized filepath and symbol maps, filled in by
+  // FinalizeAddedIncludes().  They only hold the keys whose finalized
+  // values differ from those in snapshot_ due to mappings_, and take
+  // priority over the snapshot's.
+  IncludeMap finalized_filepath_include_map_;
+  IncludeMap finalized_symbol_include_map_;
+  IncludeMap finalized_fwd_decl_symbol_map_;
+
+  // The filepaths and quoted includes in the two maps below.  They are
+  // only interned while includes are added, before the picker is shared
+  // between threads.
+  StringInterner interned_paths_;
 
   // All the includes we've seen so far, to help with globbing and
   // other dynamic mapping.  For each file, we list who #includes it.
-  map<string, set<string>> quoted_includes_to_quoted_includers_;
+  llvm::DenseMap<InternedString, llvm::DenseSet<InternedString>>
+      quoted_includes_to_quoted_includers_;
 
   // Given the filepaths of an includer and includee, give the
   // include-as-written (including <>'s or ""'s) that the includer
   // used to refer to the includee.  We use this to return includes as
   // they were written in the source, when possible.
-  map<pair<string, string>, string>
+  llvm::DenseMap<pair<InternedString, InternedString>, InternedString>
       includer_and_includee_to_include_as_written_;
 
   // Maps from a quoted filepath pattern to the set of files that used
@@ -319,6 +435,15 @@ class IncludePicker {
   // contents of friend_to_headers_map_["@\"foo/bar/.*\""].
   map<string, set<string>> friend_to_headers_map_;
 
+  // The memo of GetCandidateHeadersForDecl.  Most decls have no symbol
+  // mapping, so this mostly holds empty vectors.  Decls are unique keys
+  // as there is one include-picker per translation unit.  It is the only
+  // state the const query methods change, and with --jobs they are called
+  // for several files at once.
+  mutable std::mutex decl_symbol_headers_mutex_;
+  mutable llvm::DenseMap<const clang::NamedDecl*, vector<MappedInclude>>
+      decl_symbol_headers_;
+
   // Make sure we don't do any non-const operations after finalizing.
   bool has_called_finalize_added_include_lines_;
 
@@ -33,6 +33,28 @@ bool LineHasText(SourceLocation source_location, StringRef text) {
   return data.find(text) != StringRef::npos;
 }
 
+bool HasPragmaComment(StringRef text, StringRef pragma) {
+  const StringRef kPragmaPrefix = "IWYU pragma: ";
+  // Both comment openers, "// " and "/* ", are three characters long.
+  const size_t kOpenerLength = 3;
+  for (size_t pos = text.find(kPragmaPrefix); pos != StringRef::npos;
+       pos = text.find(kPragmaPrefix, pos + 1)) {
+    if (pos < kOpenerLength ||
+        !text.substr(pos + kPragmaPrefix.size()).starts_with(pragma))
+      continue;
+    const StringRef opener = text.substr(pos - kOpenerLength, kOpenerLength);
+    if (opener == "// " || opener == "/* ")
+      return true;
+  }
+  return false;
+}
+
+bool LineHasPragma(SourceLocation source_location, StringRef pragma) {
+  return HasPragmaComment(
+      GetSourceTextUntilEndOfLine(source_location, DefaultDataGetter()),
+      pragma);
+}
+
 // SourceManagerCharacterDataGetter method implementations.
 SourceManagerCharacterDataGetter::SourceManagerCharacterDataGetter(
     const SourceManager& source_manager)
@@ -68,6 +90,31 @@ SourceLocation GetLocationAfter(
   return start_loc.getLocWithOffset(needle_loc - data + needle.length());
 }
 
+StringRef GetLeadingCommentText(
+    SourceLocation start_loc, const CharacterDataGetterInterface& data_getter) {
+  const char* data = data_getter.GetCharacterData(start_loc);
+  const char* end = data;
+  while (true) {
+    end += strspn(end, " \t\v\f\r\n");
+    if (end[0] != '/')
+      break;
+    if (end[1] == '/') {
+      const char* line_end = strchr(end, '\n');
+      if (!line_end)
+        return data;
+      end = line_end + 1;
+    } else if (end[1] == '*') {
+      const char* comment_end = strstr(end + 2, "*/");
+      if (!comment_end)
+        return data;
+      end = comment_end + 2;
+    } else {
+      break;
+    }
+  }
+  return StringRef(data, end - data);
+}
+
 string GetIncludeNameAsWritten(
     SourceLocation include_loc,
     const CharacterDataGetterInterface& data_getter) {
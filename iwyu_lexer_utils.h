@@ -31,6 +31,16 @@ using std::string;
 // (Case sensitive.)
 bool LineHasText(clang::SourceLocation source_location, llvm::StringRef text);
 
+// Returns true if text has an "// IWYU pragma: <pragma>" or
+// "/* IWYU pragma: <pragma>" comment.  Both forms are looked for in a
+// single scan of text.
+bool HasPragmaComment(llvm::StringRef text, llvm::StringRef pragma);
+
+// For a particular source line that source_location points to,
+// returns true if it has an IWYU pragma comment, as above.
+bool LineHasPragma(clang::SourceLocation source_location,
+                   llvm::StringRef pragma);
+
 // Interface to get character data from a SourceLocation. This allows
 // tests to avoid constructing a SourceManager yet still allow iwyu to
 // get the character data from SourceLocations.
@@ -63,6 +73,13 @@ clang::SourceLocation GetLocationAfter(
     clang::SourceLocation start_loc, const string& needle,
     const CharacterDataGetterInterface& data_getter);
 
+// Returns the text from start_loc up to the first token, i.e. any comments
+// and whitespace.  At the beginning of a file, this is the leading comment
+// block with license and file documentation.
+llvm::StringRef GetLeadingCommentText(
+    clang::SourceLocation start_loc,
+    const CharacterDataGetterInterface& data_getter);
+
 // Returns the include-name as written, including <>'s and ""'s.
 // Resolved computed includes first, so given
 //    #define INC  <stdio.h>
@@ -9,6 +9,8 @@
 
 #include "iwyu_location_util.h"
 
+#include <mutex>
+
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/AST/DeclCXX.h"
@@ -50,6 +52,34 @@ using clang::UnresolvedMemberExpr;
 
 namespace include_what_you_use {
 
+static std::mutex source_manager_mutex;
+static bool source_manager_is_shared = false;
+
+SourceManagerLock::SourceManagerLock() : locked_(source_manager_is_shared) {
+  if (locked_)
+    source_manager_mutex.lock();
+}
+
+SourceManagerLock::~SourceManagerLock() {
+  if (locked_)
+    source_manager_mutex.unlock();
+}
+
+void SetSourceManagerIsShared(bool is_shared) {
+  source_manager_is_shared = is_shared;
+}
+
+ParallelCalculationLock::ParallelCalculationLock(std::mutex& mutex)
+    : mutex_(source_manager_is_shared ? &mutex : nullptr) {
+  if (mutex_)
+    mutex_->lock();
+}
+
+ParallelCalculationLock::~ParallelCalculationLock() {
+  if (mutex_)
+    mutex_->unlock();
+}
+
 // This works around two bugs(?) in clang where decl->getLocation()
 // can be wrong for implicit template instantiations and functions.
 // (1) Consider the following code:
@@ -180,6 +210,7 @@ SourceLocation GetLocation(const TemplateArgumentLoc* argloc) {
 SourceLocation GetFileStartLoc(OptionalFileEntryRef file) {
   if (!file)
     return SourceLocation();
+  SourceManagerLock lock;
   return GlobalSourceManager()->translateFileLineCol(*file, 1, 1);
 }
 
@@ -197,6 +228,7 @@ bool IsHeaderFile(OptionalFileEntryRef file) {
 
 bool IsSystemHeader(OptionalFileEntryRef file) {
   SourceLocation loc = GetFileStartLoc(file);
+  SourceManagerLock lock;
   return GlobalSourceManager()->isInSystemHeader(loc);
 }
 
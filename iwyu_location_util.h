@@ -42,8 +42,15 @@
 #ifndef INCLUDE_WHAT_YOU_USE_IWYU_LOCATION_UTIL_H_
 #define INCLUDE_WHAT_YOU_USE_IWYU_LOCATION_UTIL_H_
 
+#include <cstddef>                      // for size_t
+#include <iterator>                     // for forward_iterator_tag
+#include <memory>                       // for unique_ptr, make_unique
+#include <mutex>                        // for mutex
 #include <optional>
 #include <string>                       // for string
+#include <tuple>                        // for forward_as_tuple
+#include <utility>                      // for pair, piecewise_construct
+#include <vector>                       // for vector
 
 #include "clang/Basic/FileEntry.h"
 #include "clang/Basic/SourceLocation.h"
@@ -51,6 +58,7 @@
 #include "clang/Lex/Token.h"
 #include "iwyu_globals.h"
 #include "iwyu_path_util.h"
+#include "iwyu_port.h"  // for CHECK_
 
 namespace clang {
 class Decl;
@@ -62,7 +70,10 @@ class TypeLoc;
 
 namespace include_what_you_use {
 
+using std::pair;
 using std::string;
+using std::unique_ptr;
+using std::vector;
 
 //------------------------------------------------------------
 // Helper functions for FileEntry.
@@ -89,15 +100,61 @@ inline string GetFilePath(clang::FileEntryRef file) {
   return NormalizeFilePath(file.getName());
 }
 
+//------------------------------------------------------------
+// Serialized access to the global SourceManager.
+
+// Clang's SourceManager memoizes lookups in mutable members, so it can't
+// be queried from several threads at once.  While iwyu violations are
+// calculated on several threads (see --jobs), every SourceManager query
+// made by iwyu holds this lock.  That includes printing decls and types:
+// Clang prints unnamed ones, e.g. "(anonymous struct at a.h:3:1)", with
+// their location.  Otherwise it is a no-op.
+class SourceManagerLock {
+ public:
+  SourceManagerLock();
+  ~SourceManagerLock();
+
+  SourceManagerLock(const SourceManagerLock&) = delete;
+  SourceManagerLock& operator=(const SourceManagerLock&) = delete;
+
+ private:
+  bool locked_;
+};
+
+// Turns the SourceManagerLock on or off.  Must only be called while no
+// other thread may use the SourceManager.
+void SetSourceManagerIsShared(bool is_shared);
+
+// Serialized access to iwyu's own memos that are filled in while iwyu
+// violations are calculated.  Like SourceManagerLock, it only locks mutex
+// while the calculation runs on several threads.
+class ParallelCalculationLock {
+ public:
+  explicit ParallelCalculationLock(std::mutex& mutex);
+  ~ParallelCalculationLock();
+
+  ParallelCalculationLock(const ParallelCalculationLock&) = delete;
+  ParallelCalculationLock& operator=(const ParallelCalculationLock&) = delete;
+
+ private:
+  std::mutex* mutex_;  // null if not locked
+};
+
 //------------------------------------------------------------
 // Helper functions for SourceLocation
 
 inline clang::SourceLocation GetSpellingLoc(clang::SourceLocation loc) {
-  return loc.isValid() ? GlobalSourceManager()->getSpellingLoc(loc) : loc;
+  if (!loc.isValid())
+    return loc;
+  SourceManagerLock lock;
+  return GlobalSourceManager()->getSpellingLoc(loc);
 }
 
 inline clang::SourceLocation GetInstantiationLoc(clang::SourceLocation loc) {
-  return loc.isValid() ? GlobalSourceManager()->getExpansionLoc(loc) : loc;
+  if (!loc.isValid())
+    return loc;
+  SourceManagerLock lock;
+  return GlobalSourceManager()->getExpansionLoc(loc);
 }
 
 inline bool IsInMacro(clang::SourceLocation loc) {
@@ -112,6 +169,7 @@ inline bool IsInMacro(clang::SourceLocation loc) {
 inline int GetLineNumber(clang::SourceLocation loc) {
   if (!loc.isValid())
     return -1;
+  SourceManagerLock lock;
   clang::SourceManager& sm = *GlobalSourceManager();
   bool invalid = false;
   int retval = sm.getSpellingLineNumber(loc, &invalid);
@@ -134,6 +192,7 @@ inline clang::OptionalFileEntryRef GetLocFileEntry(clang::SourceLocation loc) {
   // a particular series of #includes.'  (What one might think a FileID
   // might be -- a unique reference to a filesystem object -- is
   // actually a FileEntry.)
+  SourceManagerLock lock;
   const clang::SourceManager& source_manager = *GlobalSourceManager();
   return source_manager.getFileEntryRefForID(source_manager.getFileID(loc));
 }
@@ -219,6 +278,7 @@ inline bool IsBeforeInTranslationUnit(const T& a, const U& b) {
   if ((IsInMacro(a_loc) || IsInMacro(b_loc)) &&
       GetInstantiationLoc(a_loc) == GetInstantiationLoc(b_loc))
     return true;
+  SourceManagerLock lock;
   return GlobalSourceManager()->isBeforeInTranslationUnit(a_loc, b_loc);
 }
 
@@ -275,6 +335,160 @@ bool IsInHeader(const T& obj) {
 // Returns true if file is a system header.
 bool IsSystemHeader(clang::OptionalFileEntryRef file);
 
+// A map from files to values of type T, kept in a vector indexed by the
+// files' unique IDs, which clang hands out densely as it opens files.
+// Lookups are O(1), and values keep their addresses as the map grows, like
+// those of std::map.  The empty OptionalFileEntryRef is a valid key.
+// Iteration is in order of unique ID, i.e. the order in which clang first
+// opened the files.
+template <typename T>
+class FileMap {
+ public:
+  typedef clang::OptionalFileEntryRef key_type;
+  typedef T mapped_type;
+  typedef pair<const key_type, T> value_type;
+
+ private:
+  typedef vector<unique_ptr<value_type>> Slots;
+
+  // Iterates over the occupied slots.
+  template <typename Value>
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Value* pointer;
+    typedef Value& reference;
+
+    Iterator(typename Slots::const_iterator it,
+             typename Slots::const_iterator end)
+        : it_(it), end_(end) {
+      SkipEmptySlots();
+    }
+    // Allows conversion from iterator to const_iterator.
+    template <typename Other>
+    Iterator(const Iterator<Other>& other)  // NOLINT
+        : it_(other.it_), end_(other.end_) {
+    }
+
+    Value& operator*() const {
+      return **it_;
+    }
+    Value* operator->() const {
+      return it_->get();
+    }
+    Iterator& operator++() {
+      ++it_;
+      SkipEmptySlots();
+      return *this;
+    }
+    bool operator==(const Iterator& other) const {
+      return it_ == other.it_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return it_ != other.it_;
+    }
+
+   private:
+    template <typename Other>
+    friend class Iterator;
+
+    void SkipEmptySlots() {
+      while (it_ != end_ && *it_ == nullptr)
+        ++it_;
+    }
+
+    typename Slots::const_iterator it_;
+    typename Slots::const_iterator end_;
+  };
+
+ public:
+  typedef Iterator<value_type> iterator;
+  typedef Iterator<const value_type> const_iterator;
+
+  FileMap() : size_(0) {
+  }
+
+  iterator begin() {
+    return iterator(slots_.cbegin(), slots_.cend());
+  }
+  iterator end() {
+    return iterator(slots_.cend(), slots_.cend());
+  }
+  const_iterator begin() const {
+    return const_iterator(slots_.cbegin(), slots_.cend());
+  }
+  const_iterator end() const {
+    return const_iterator(slots_.cend(), slots_.cend());
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+  iterator find(key_type file) {
+    const size_t index = Index(file);
+    if (index >= slots_.size() || slots_[index] == nullptr)
+      return end();
+    return iterator(slots_.cbegin() + index, slots_.cend());
+  }
+  const_iterator find(key_type file) const {
+    return const_cast<FileMap*>(this)->find(file);
+  }
+
+  // Constructs the value for file from args, unless file already has one.
+  // Returns the value for file, and whether it was inserted.
+  template <typename... Args>
+  pair<iterator, bool> emplace(key_type file, Args&&... args) {
+    const size_t index = Index(file);
+    if (index >= slots_.size())
+      slots_.resize(index + 1);
+    const bool inserted = (slots_[index] == nullptr);
+    if (inserted) {
+      slots_[index] = std::make_unique<value_type>(
+          std::piecewise_construct, std::forward_as_tuple(file),
+          std::forward_as_tuple(std::forward<Args>(args)...));
+      ++size_;
+    }
+    return {iterator(slots_.cbegin() + index, slots_.cend()), inserted};
+  }
+
+  T& operator[](key_type file) {
+    return emplace(file).first->second;
+  }
+
+  const T& at(key_type file) const {
+    const_iterator it = find(file);
+    CHECK_(it != end() && "FileMap::at: no value for file");
+    return it->second;
+  }
+
+ private:
+  static size_t Index(key_type file) {
+    return file ? file->getUID() + 1 : 0;
+  }
+
+  Slots slots_;
+  size_t size_;
+};
+
+// Returns a pointer to (*a_map)[file] if file is in *a_map; otherwise
+// returns nullptr.
+template <typename T>
+const T* FindInMap(const FileMap<T>* a_map, clang::OptionalFileEntryRef file) {
+  const typename FileMap<T>::const_iterator it = a_map->find(file);
+  return it == a_map->end() ? nullptr : &it->second;
+}
+template <typename T>
+T* FindInMap(FileMap<T>* a_map, clang::OptionalFileEntryRef file) {
+  const typename FileMap<T>::iterator it = a_map->find(file);
+  return it == a_map->end() ? nullptr : &it->second;
+}
+
 }  // namespace include_what_you_use
 
 #endif  // INCLUDE_WHAT_YOU_USE_IWYU_LOCATION_UTIL_H_
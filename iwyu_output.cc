@@ -14,6 +14,7 @@
 #include <iterator>                     // for inserter
 #include <list>
 #include <map>                          // for _Rb_tree_const_iterator, etc
+#include <memory>                       // for make_unique
 #include <utility>                      // for pair, make_pair, operator>
 #include <vector>                       // for vector, vector<>::iterator, etc
 
@@ -37,8 +38,10 @@
 #include "iwyu_string_util.h"
 #include "iwyu_verrs.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/TimeProfiler.h"
 
 namespace include_what_you_use {
 
@@ -65,7 +68,6 @@ using clang::TypeSourceInfo;
 using clang::UsingDecl;
 using llvm::cast;
 using llvm::dyn_cast;
-using llvm::errs;
 using llvm::find_if;
 using llvm::isa;
 using llvm::raw_string_ostream;
@@ -147,16 +149,19 @@ string OutputLine::printable_line(size_t min_length, size_t max_length) const {
   return result;
 }
 
-// A map that effectively allows us to dynamic cast from a NamedDecl
-// to a FakeNamedDecl. When a FakeNamedDecl is created, it will be
-// inserted into the map with itself as the key (implicitly casted to
-// a NamedDecl).
-std::map<const NamedDecl*, const FakeNamedDecl*> g_fake_named_decl_map;
+// A set that effectively allows us to dynamic cast from a NamedDecl
+// to a FakeNamedDecl. A FakeNamedDecl is in the set (implicitly casted
+// to a NamedDecl) for as long as it lives, so a real decl that is later
+// allocated at the same address is not mistaken for it.  Outside of
+// tests, the set is empty.
+llvm::SmallPtrSet<const NamedDecl*, 4> g_fake_named_decls;
 
 // Since dynamic casting is not an option, this method is provided to
 // determine if a decl is actually a FakeNamedDecl.
 const FakeNamedDecl* FakeNamedDeclIfItIsOne(const NamedDecl* decl) {
-  return GetOrDefault(g_fake_named_decl_map, decl, nullptr);
+  if (!g_fake_named_decls.count(decl))
+    return nullptr;
+  return static_cast<const FakeNamedDecl*>(decl);
 }
 
 std::string PrintableUnderlyingType(const EnumDecl* enum_decl) {
@@ -189,7 +194,11 @@ FakeNamedDecl::FakeNamedDecl(const string& kind_name, const string& qual_name,
       qual_name_(qual_name),
       decl_filepath_(decl_filepath),
       decl_linenum_(decl_linenum) {
-  g_fake_named_decl_map[this] = this;
+  g_fake_named_decls.insert(this);
+}
+
+FakeNamedDecl::~FakeNamedDecl() {
+  g_fake_named_decls.erase(this);
 }
 
 // When testing IWYU, we provide a fake object (FakeNamedDecl) that
@@ -532,37 +541,36 @@ string MungedForwardDeclareLineForNontemplates(const TagDecl* decl) {
 // forward-declare the template, e.g.
 //     "namespace ns { template <typename T> class Foo; }".
 string MungedForwardDeclareLineForTemplates(const TemplateDecl* decl) {
-  // Temporarily remove any complete definition from the decl, to erase some
-  // noise from the printed declaration.
-  ScopedRemoveDefinition guard(dyn_cast<TagDecl>(decl->getTemplatedDecl()));
-
-  // Clang's DeclPrinter prints the class name just as we like it (with default
-  // args, requires clauses and everything) -- with logic that doesn't exist
-  // elsewhere in Clang that I can see. So, as a hack, we postprocess the
-  // printed decl to strip off keyword attributes and the template name.
+  const auto* tag_decl = dyn_cast<TagDecl>(decl->getTemplatedDecl());
+  CHECK_(tag_decl && "Only class templates can be forward-declared");
+
+  // Clang's DeclPrinter prints the template parameters just as we like them
+  // (with default args, requires clauses and everything) -- with logic that
+  // doesn't exist elsewhere in Clang that I can see.  Printing the whole
+  // decl would print its definition too, so only print the parameters and
+  // add the keyword, as the DeclPrinter would.  The decl is left alone:
+  // forward-declare lines are built while other threads may use it (see
+  // --jobs).
   std::string line;
   raw_string_ostream ostream(line);
 
-  // Print the decl using PolishForDeclaration, which strips some semantic
-  // attributes.
+  // Use PolishForDeclaration, which strips some semantic attributes.
   PrintingPolicy policy = decl->getASTContext().getPrintingPolicy();
   policy.PolishForDeclaration = true;
   policy.SuppressDeclAttributes = true;
-  decl->print(ostream, policy);
-
-  // Note that line is not a user-formatted C++ declaration at this point, but
-  // rather on the exact form printed by Clang, so it's safe to make certain
-  // assumptions about format.
-
-  // The template name is now the last word on the line. Drop it.
-  const string::size_type namepos = line.rfind(' ');
-  CHECK_(namepos != string::npos && "Unexpected printable template-type");
-  line = line.substr(0, namepos);
+  {
+    // Default args may name unnamed types, which are printed with their
+    // location.
+    SourceManagerLock lock;
+    decl->getTemplateParameters()->print(ostream, decl->getASTContext(),
+                                         policy);
+  }
+  ostream << tag_decl->getKindName();
 
   // Now we have something like 'template<class T, class U> ... class'. Rely on
   // PrintForwardDeclare to wrap that in the right namespaces and append the
   // template name.
-  return PrintForwardDeclare(decl, line, GlobalFlags().cxx17ns);
+  return PrintForwardDeclare(decl, ostream.str(), GlobalFlags().cxx17ns);
 }
 
 string MungedForwardDeclareLine(const NamedDecl* decl) {
@@ -639,6 +647,18 @@ IwyuFileInfo::IwyuFileInfo(OptionalFileEntryRef this_file,
       desired_includes_have_been_calculated_(false) {
 }
 
+IwyuFileInfo::AnalysisState& IwyuFileInfo::analysis() {
+  if (!analysis_) {
+    analysis_ = std::make_unique<AnalysisState>();
+    for (const DirectInclude& include : include_lines_) {
+      analysis_->lines.emplace_back(include.includee, include.quoted_includee,
+                                    include.linenumber);
+      analysis_->lines.back().set_present();
+    }
+  }
+  return *analysis_;
+}
+
 void IwyuFileInfo::AddAssociatedHeader(const IwyuFileInfo* other) {
   VERRS(6) << "Adding " << GetFilePath(other->file_)
            << " as associated header for " << GetFilePath(file_) << "\n";
@@ -647,16 +667,12 @@ void IwyuFileInfo::AddAssociatedHeader(const IwyuFileInfo* other) {
 
 void IwyuFileInfo::AddInclude(OptionalFileEntryRef includee,
                               const string& quoted_includee, int linenumber) {
-  OneIncludeOrForwardDeclareLine new_include(includee, quoted_includee,
-                                             linenumber);
-  new_include.set_present();
-
   // It's possible for the same #include to be seen multiple times
   // (for instance, if we include a .h file twice, and that .h file
   // does not have a header guard).  Ignore all but the first.
   // TODO(csilvers): could rewrite this so it's constant-time.
-  for (const OneIncludeOrForwardDeclareLine& line : lines_) {
-    if (line.LineNumbersMatch(new_include)) {
+  for (const DirectInclude& include : include_lines_) {
+    if (include.linenumber == linenumber) {
       VERRS(6) << "Ignoring repeated include: "
                << GetFilePath(file_) << ":" << linenumber
                << " -> " << GetFilePath(includee) << "\n";
@@ -664,7 +680,13 @@ void IwyuFileInfo::AddInclude(OptionalFileEntryRef includee,
     }
   }
 
-  lines_.push_back(new_include);
+  include_lines_.push_back({includee, quoted_includee, linenumber});
+  // If the analysis state has already been allocated, it needs the line
+  // too; otherwise analysis() builds it from include_lines_ later.
+  if (analysis_) {
+    analysis_->lines.emplace_back(includee, quoted_includee, linenumber);
+    analysis_->lines.back().set_present();
+  }
   // Store in a few other ways as well.
   direct_includes_as_fileentries_.insert(includee);
   direct_includes_.insert(quoted_includee);
@@ -678,13 +700,15 @@ void IwyuFileInfo::AddForwardDeclare(const NamedDecl* fwd_decl,
   CHECK_(fwd_decl && "forward_declare_decl unexpectedly nullptr");
   CHECK_((isa<ClassTemplateDecl>(fwd_decl) || isa<TagDecl>(fwd_decl)) &&
          "Can only forward declare tag types and class templates");
-  lines_.push_back(OneIncludeOrForwardDeclareLine(fwd_decl));
-  lines_.back().set_present();
+  ArenaVector<OneIncludeOrForwardDeclareLine>& lines = analysis().lines;
+  lines.push_back(OneIncludeOrForwardDeclareLine(fwd_decl));
+  lines.back().set_present();
   if (definitely_keep_fwd_decl)
-    lines_.back().set_desired();
-  direct_forward_declares_.insert(fwd_decl);   // store in another way as well
+    lines.back().set_desired();
+  // Store in another way as well.
+  analysis().direct_forward_declares.insert(fwd_decl);
   VERRS(6) << "Found forward-declare: "
-           << GetFilePath(file_) << ":" << lines_.back().LineNumberString()
+           << GetFilePath(file_) << ":" << lines.back().LineNumberString()
            << ": " << internal::PrintablePtr(fwd_decl)
            << internal::GetQualifiedNameAsString(fwd_decl) << "\n";
 }
@@ -692,15 +716,16 @@ void IwyuFileInfo::AddForwardDeclare(const NamedDecl* fwd_decl,
 void IwyuFileInfo::AddOwningTagType(TagTypeLoc type_loc) {
   if (!type_loc.getTypePtr()->isTagOwned())
     return;
-  lines_.push_back(OneIncludeOrForwardDeclareLine(type_loc));
+  ArenaVector<OneIncludeOrForwardDeclareLine>& lines = analysis().lines;
+  lines.push_back(OneIncludeOrForwardDeclareLine(type_loc));
   VERRS(6) << "Found owning elaborated type: " << GetFilePath(file_) << ":"
-           << lines_.back().LineNumberString() << ": "
+           << lines.back().LineNumberString() << ": "
            << PrintableTypeLoc(type_loc) << "\n";
 }
 
 void IwyuFileInfo::AddUsingDecl(const UsingDecl* using_decl) {
   CHECK_(using_decl && "using_decl unexpectedly nullptr");
-  using_decl_referenced_.insert(std::make_pair(using_decl, false));
+  analysis().using_decl_referenced.insert(std::make_pair(using_decl, false));
   const SourceRange decl_lines = using_decl->getSourceRange();
   int start_linenum = GetLineNumber(GetInstantiationLoc(decl_lines.getBegin()));
   int end_linenum = GetLineNumber(GetInstantiationLoc(decl_lines.getEnd()));
@@ -757,24 +782,27 @@ void IwyuFileInfo::ReportFullSymbolUse(SourceLocation use_loc,
       report_decl_loc = decl->getLocation();
     }
 
-    symbol_uses_.push_back(OneUse(report_decl, use_loc, report_decl_loc,
-                                  UseKind::Full, flags, comment));
-    LogSymbolUse("Marked full-info use of decl", symbol_uses_.back());
+    ArenaVector<OneUse>& symbol_uses = analysis().symbol_uses;
+    symbol_uses.push_back(OneUse(report_decl, use_loc, report_decl_loc,
+                                 UseKind::Full, flags, comment));
+    LogSymbolUse("Marked full-info use of decl", symbol_uses.back());
   }
 }
 
 void IwyuFileInfo::ReportFullSymbolUse(SourceLocation use_loc,
                                        OptionalFileEntryRef dfn_file,
                                        const string& symbol) {
-  symbol_uses_.push_back(OneUse(symbol, dfn_file, use_loc));
-  LogSymbolUse("Marked full-info use of symbol", symbol_uses_.back());
+  ArenaVector<OneUse>& symbol_uses = analysis().symbol_uses;
+  symbol_uses.push_back(OneUse(symbol, dfn_file, use_loc));
+  LogSymbolUse("Marked full-info use of symbol", symbol_uses.back());
 }
 
 void IwyuFileInfo::ReportMacroUse(SourceLocation use_loc,
                                   SourceLocation dfn_loc,
                                   const string& symbol) {
-  symbol_uses_.push_back(OneUse(symbol, GetFileEntry(dfn_loc), use_loc));
-  LogSymbolUse("Marked full-info use of macro", symbol_uses_.back());
+  ArenaVector<OneUse>& symbol_uses = analysis().symbol_uses;
+  symbol_uses.push_back(OneUse(symbol, GetFileEntry(dfn_loc), use_loc));
+  LogSymbolUse("Marked full-info use of macro", symbol_uses.back());
 }
 
 void IwyuFileInfo::ReportDefinedMacroUse(OptionalFileEntryRef used_in) {
@@ -784,8 +812,9 @@ void IwyuFileInfo::ReportDefinedMacroUse(OptionalFileEntryRef used_in) {
 void IwyuFileInfo::ReportIncludeFileUse(OptionalFileEntryRef included_file,
                                         const string& quoted_include,
                                         SourceLocation include_loc) {
-  symbol_uses_.push_back(OneUse(included_file, quoted_include, include_loc));
-  LogIncludeFileUse("Marked use of include-file", symbol_uses_.back());
+  ArenaVector<OneUse>& symbol_uses = analysis().symbol_uses;
+  symbol_uses.push_back(OneUse(included_file, quoted_include, include_loc));
+  LogIncludeFileUse("Marked use of include-file", symbol_uses.back());
 }
 
 void IwyuFileInfo::ReportIncludeFileUse(OptionalFileEntryRef included_file,
@@ -808,9 +837,10 @@ void IwyuFileInfo::ReportForwardDeclareUse(SourceLocation use_loc,
   // combines friend decls with true forward-declare decls.  If that
   // happened here, replace the friend with a real fwd decl.
   decl = GetNonfriendClassRedecl(decl);
-  symbol_uses_.push_back(OneUse(decl, use_loc, GetLocation(decl),
-                                UseKind::FwdDecl, flags, comment));
-  LogSymbolUse("Marked fwd-decl use of decl", symbol_uses_.back());
+  ArenaVector<OneUse>& symbol_uses = analysis().symbol_uses;
+  symbol_uses.push_back(OneUse(decl, use_loc, GetLocation(decl),
+                               UseKind::FwdDecl, flags, comment));
+  LogSymbolUse("Marked fwd-decl use of decl", symbol_uses.back());
 }
 
 void IwyuFileInfo::ReportUsingDeclUse(SourceLocation use_loc,
@@ -822,9 +852,11 @@ void IwyuFileInfo::ReportUsingDeclUse(SourceLocation use_loc,
   // traversing the AST, we check to see if a using decl is unreferenced and
   // add a full use of one of its shadow decls so that the source file
   // continues to compile.
-  auto using_decl_status = using_decl_referenced_.find(using_decl);
+  map<const UsingDecl*, bool>& using_decl_referenced =
+      analysis().using_decl_referenced;
+  auto using_decl_status = using_decl_referenced.find(using_decl);
 
-  if (using_decl_status != using_decl_referenced_.end()) {
+  if (using_decl_status != using_decl_referenced.end()) {
     using_decl_status->second = true;
   }
 
@@ -921,7 +953,7 @@ set<string> CalculateMinimalIncludes(
     const string& use_quoted_include,
     const set<string>& direct_includes,
     const set<string>& associated_desired_includes,
-    vector<OneUse>* uses) {
+    ArenaVector<OneUse>* uses) {
   set<string> desired_headers;
 
   // TODO(csilvers): if a use's decl supports equivalent redecls
@@ -1354,15 +1386,15 @@ void ProcessForwardDeclare(OneUse* use,
 // Returns true if the given symbol has a mapping defined to a file.
 static bool HasMapping(const NamedDecl* decl) {
   const IncludePicker& picker = GlobalIncludePicker();
-  string with_fn_args = GetWrittenQualifiedNameAsString(decl, true);
+  const string& with_fn_args = GetWrittenQualifiedNameAsString(decl, true);
   if (!picker.GetCandidateHeadersForSymbol(with_fn_args).empty())
     return true;
-  string without_fn_args = GetWrittenQualifiedNameAsString(decl, false);
+  const string& without_fn_args = GetWrittenQualifiedNameAsString(decl, false);
   return !picker.GetCandidateHeadersForSymbol(without_fn_args).empty();
 }
 
 void ProcessFullUse(OneUse* use, const IwyuPreprocessorInfo* preprocessor_info,
-                    const vector<OneUse>& all_uses) {
+                    const ArenaVector<OneUse>& all_uses) {
   CHECK_(use->decl() && "Must call ProcessFullUse on a decl");
   CHECK_(use->is_full_use() && "Must not call ProcessFullUse on fwd-decl");
   if (use->ignore_use())   // we're already ignoring it
@@ -1829,7 +1861,7 @@ void CalculateIwyuForFullUse(OneUse* use,
 
 }  // namespace internal
 
-void IwyuFileInfo::CalculateIwyuViolations(vector<OneUse>* uses) {
+void IwyuFileInfo::CalculateIwyuViolations(ArenaVector<OneUse>* uses) {
   VERRS(6) << "--- Calculating IWYU violations for "
            << GetFilePath(file_) << " ---\n";
 
@@ -1870,7 +1902,7 @@ void IwyuFileInfo::CalculateIwyuViolations(vector<OneUse>* uses) {
   for (const string& quoted_include : desired_set_cover) {
     if (IsQuotedHeaderFilename(quoted_include) ||
         ContainsKey(direct_includes(), quoted_include))
-      desired_includes_.insert(quoted_include);
+      analysis().desired_includes.insert(quoted_include);
   }
   desired_includes_have_been_calculated_ = true;
 
@@ -1919,7 +1951,8 @@ static string GetWarningMsg(const OneUse& use) {
   return warning;
 }
 
-int IwyuFileInfo::EmitWarningMessages(const vector<OneUse>& uses) {
+int IwyuFileInfo::EmitWarningMessages(const ArenaVector<OneUse>& uses,
+                                      string* output) {
   set<pair<int, string>> iwyu_warnings;   // line-number, warning-msg.
   for (const OneUse& use : uses) {
     if (use.is_iwyu_violation())
@@ -1928,7 +1961,7 @@ int IwyuFileInfo::EmitWarningMessages(const vector<OneUse>& uses) {
   // Nice that set<> automatically sorts things for us!
   for (const pair<int, string>& warning : iwyu_warnings) {
     if (ShouldPrint(3)) {
-      errs() << warning.second;
+      *output += warning.second;
     } else if (ShouldPrint(2)) {
       // TODO(csilvers): print one warning per sym per file.
     }
@@ -1939,7 +1972,7 @@ int IwyuFileInfo::EmitWarningMessages(const vector<OneUse>& uses) {
 namespace internal {
 
 template <class IncludeOrFwdDecl>
-bool Contains(const vector<OneIncludeOrForwardDeclareLine>& lines,
+bool Contains(const ArenaVector<OneIncludeOrForwardDeclareLine>& lines,
               const IncludeOrFwdDecl& item) {
   return std::any_of(lines.begin(), lines.end(),
                      [&](const OneIncludeOrForwardDeclareLine& line) {
@@ -1963,9 +1996,10 @@ void ClearDesiredForSurplusIncludesOrForwardDeclares(ContainerType& container) {
 }
 
 void CalculateDesiredIncludesAndForwardDeclares(
-    const vector<OneUse>& uses, const set<string>& associated_desired_includes,
+    const ArenaVector<OneUse>& uses,
+    const set<string>& associated_desired_includes,
     const set<OptionalFileEntryRef>& kept_includes,
-    vector<OneIncludeOrForwardDeclareLine>* lines) {
+    ArenaVector<OneIncludeOrForwardDeclareLine>* lines) {
   // First make sure all uses' includes and fwd decls are reflected in lines.
   for (const OneUse& use : uses) {
     if (use.ignore_use())
@@ -2108,7 +2142,7 @@ bool IsRemovablePrefixHeader(OptionalFileEntryRef file_entry,
 
 void CleanupPrefixHeaderIncludes(
     const IwyuPreprocessorInfo* preprocessor_info,
-    vector<OneIncludeOrForwardDeclareLine>* lines) {
+    ArenaVector<OneIncludeOrForwardDeclareLine>* lines) {
   CommandlineFlags::PrefixHeaderIncludePolicy policy =
       GlobalFlags().prefix_header_include_policy;
   if (policy == CommandlineFlags::kAdd)
@@ -2241,12 +2275,22 @@ LineSortKey GetSortKey(const OneIncludeOrForwardDeclareLine& line,
   return LineSortKey(GetLineSortOrdinal(line, associated_quoted_includes, file_info), line.line());
 }
 
+// Returns the number of lines to add or remove, without printing them.
+size_t CountEdits(const ArenaVector<OneIncludeOrForwardDeclareLine>& lines) {
+  size_t num_edits = 0;
+  for (const OneIncludeOrForwardDeclareLine& line : lines) {
+    if (line.is_desired() != line.is_present())   // add or delete
+      ++num_edits;
+  }
+  return num_edits;
+}
+
 // filename is "this" filename: the file being emitted.
 // associated_filepaths are the quoted-include form of associated_headers_.
 size_t PrintableDiffs(const string& filename,
                       const IwyuPreprocessorInfo* preprocessor_info,
                       const set<string>& associated_quoted_includes,
-                      const vector<OneIncludeOrForwardDeclareLine>& lines,
+                      const ArenaVector<OneIncludeOrForwardDeclareLine>& lines,
                       string* diff_output) {
   CHECK_(diff_output && "Must provide diff_output");
 
@@ -2418,8 +2462,10 @@ void IwyuFileInfo::ResolvePendingAnalysis() {
   // thorough approach would be to scan the current list of includes that
   // already name this decl (like in the overloaded function case) and include
   // one of those so we don't include a file we don't actually need.
+  if (!analysis_)
+    return;
   for (map<const UsingDecl*, bool>::value_type using_decl_status
-      : using_decl_referenced_) {
+      : analysis_->using_decl_referenced) {
     if (!using_decl_status.second) {
       // There are valid cases where there is no shadow decl, e.g. if a derived
       // class has a using declaration for a member, but also hides it.
@@ -2435,7 +2481,10 @@ void IwyuFileInfo::ResolvePendingAnalysis() {
   }
 }
 
-size_t IwyuFileInfo::CalculateAndReportIwyuViolations() {
+size_t IwyuFileInfo::CalculateAndReportIwyuViolations(string* output) {
+  llvm::TimeTraceScope trace_scope("IWYU CalculateAndReportIwyuViolations",
+                                   [this] { return GetFilePath(file_); });
+
   // This is used to calculate our own desired includes.  That depends
   // on what our associated files' desired includes are: if we use
   // bar.h and foo.h is adding it, we don't need to add it ourself.
@@ -2443,27 +2492,38 @@ size_t IwyuFileInfo::CalculateAndReportIwyuViolations() {
   // we *do* need to add it.
   set<string> associated_desired_includes = AssociatedDesiredIncludes();
 
-  CalculateIwyuViolations(&symbol_uses_);
-  EmitWarningMessages(symbol_uses_);
+  AnalysisState& state = analysis();
+  CalculateIwyuViolations(&state.symbol_uses);
+  if (!GlobalFlags().check_only)
+    EmitWarningMessages(state.symbol_uses, output);
   internal::CalculateDesiredIncludesAndForwardDeclares(
-      symbol_uses_, associated_desired_includes, kept_includes_,  &lines_);
+      state.symbol_uses, associated_desired_includes, kept_includes_,
+      &state.lines);
 
   // Remove desired inclusions that have been inhibited by pragma
   // "no_include".
-  for (OneIncludeOrForwardDeclareLine& line : lines_) {
+  for (OneIncludeOrForwardDeclareLine& line : state.lines) {
     if (line.IsIncludeLine() &&
         preprocessor_info_->IncludeIsInhibited(file_, line.quoted_include())) {
       line.clear_desired();
     }
   }
 
-  internal::CleanupPrefixHeaderIncludes(preprocessor_info_, &lines_);
+  internal::CleanupPrefixHeaderIncludes(preprocessor_info_, &state.lines);
+
+  // In check-only mode all we want to know is whether there are edits.
+  if (GlobalFlags().check_only) {
+    const size_t num_edits = internal::CountEdits(state.lines);
+    if (num_edits > 0)
+      *output += "\n(" + GetFilePath(file_) + " has iwyu violations)\n";
+    return num_edits;
+  }
 
   string diff_output;
   size_t num_edits = internal::PrintableDiffs(
       GetFilePath(file_), preprocessor_info_, AssociatedQuotedIncludes(),
-      lines_, &diff_output);
-  errs() << diff_output;
+      state.lines, &diff_output);
+  *output += diff_output;
 
   return num_edits;
 }
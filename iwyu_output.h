@@ -18,6 +18,7 @@
 
 #include <cstddef>
 #include <map>                          // for map
+#include <memory>                       // for unique_ptr
 #include <set>                          // for set
 #include <string>                       // for string, operator<
 #include <vector>                       // for vector
@@ -25,6 +26,7 @@
 #include "clang/AST/Decl.h"
 #include "clang/Basic/FileEntry.h"
 #include "clang/Basic/SourceLocation.h"
+#include "iwyu_arena.h"
 #include "iwyu_port.h"  // for CHECK_
 #include "iwyu_stl_util.h"
 #include "iwyu_use_flags.h"
@@ -42,6 +44,7 @@ namespace include_what_you_use {
 using std::map;
 using std::set;
 using std::string;
+using std::unique_ptr;
 using std::vector;
 
 class IwyuPreprocessorInfo;
@@ -263,6 +266,10 @@ class IwyuFileInfo {
     return direct_includes_;
   }
 
+  const set<const IwyuFileInfo*>& associated_headers() const {
+    return associated_headers_;
+  }
+
   // An 'associated' header is a header that this file #includes
   // (possibly indirectly) that we should treat as being logically
   // part of this file.  In particular, when computing the direct
@@ -352,16 +359,44 @@ class IwyuFileInfo {
 
   // The meat of iwyu: compare the actual includes and forward-declares
   // against the symbol uses, and report which uses are iwyu violations.
-  // Reports violations on errs(), and returns the number of violations.
-  size_t CalculateAndReportIwyuViolations();
+  // Appends the report to output, and returns the number of violations.
+  // The associated headers must have been calculated before this file.
+  // Apart from that, different files can be calculated concurrently.
+  size_t CalculateAndReportIwyuViolations(string* output);
 
  private:
+  // The state needed to calculate iwyu violations for this file.  Most
+  // files seen during preprocessing (system headers, in particular) have
+  // nothing reported against them and are never analyzed, so this lives
+  // in a separate struct that is only allocated when first needed.  Its
+  // uses and lines are in the arena of the translation unit.
+  struct AnalysisState {
+    // Holds all the uses that are reported.
+    ArenaVector<OneUse> symbol_uses;
+
+    // Holds all the lines (#include and fwd-declare) that are reported.
+    ArenaVector<OneIncludeOrForwardDeclareLine> lines;
+
+    // Maps all the using-decls that are reported to a bool indicating
+    // whether or not the using decl has been referenced in this file.
+    map<const clang::UsingDecl*, bool> using_decl_referenced;
+
+    set<const clang::NamedDecl*> direct_forward_declares;
+
+    // What we will recommend the #includes to be.
+    set<string> desired_includes;
+  };
+
   const set<string>& desired_includes() const {
     CHECK_(desired_includes_have_been_calculated_ &&
            "Must calculate desired includes before calling desired_includes()");
-    return desired_includes_;
+    return analysis_->desired_includes;
   }
 
+  // Returns the analysis state, allocating it (and the lines for the
+  // #includes seen so far) on first use.
+  AnalysisState& analysis();
+
   set<string> AssociatedQuotedIncludes() const {
     set<string> associated_quoted_includes;
     for (const IwyuFileInfo* associated : associated_headers_)
@@ -385,10 +420,10 @@ class IwyuFileInfo {
   }
 
   // Populates uses with full data, including is_iwyu_violation_.
-  void CalculateIwyuViolations(vector<OneUse>* uses);
-  // Uses uses to emit warning messages (at high enough verbosity).
-  // Returns the number of warning messages found.
-  int EmitWarningMessages(const vector<OneUse>& uses);
+  void CalculateIwyuViolations(ArenaVector<OneUse>* uses);
+  // Uses uses to emit warning messages to output (at high enough
+  // verbosity).  Returns the number of warning messages found.
+  int EmitWarningMessages(const ArenaVector<OneUse>& uses, string* output);
 
   // The constructor arguments.  file_ is 'this file'.
   clang::OptionalFileEntryRef file_;
@@ -410,21 +445,21 @@ class IwyuFileInfo {
   // foo.h and foo-inl.h, if present.
   set<const IwyuFileInfo*> associated_headers_;
 
-  // Holds all the uses that are reported.
-  vector<OneUse> symbol_uses_;
-
-  // Holds all the lines (#include and fwd-declare) that are reported.
-  vector<OneIncludeOrForwardDeclareLine> lines_;
-
-  // Maps all the using-decls that are reported to a bool indicating whether
-  // or not a the using decl has been referenced in this file.
-  map<const clang::UsingDecl*, bool> using_decl_referenced_;
-
-  // We also hold the line information in a few other data structures,
+  // The #includes seen in this file, in the order they were seen.  This
+  // is all the include information most files need; the corresponding
+  // OneIncludeOrForwardDeclareLines are only built for files that are
+  // analyzed (see analysis()).
+  struct DirectInclude {
+    clang::OptionalFileEntryRef includee;
+    string quoted_includee;
+    int linenumber;
+  };
+  vector<DirectInclude> include_lines_;
+
+  // We also hold the include information in a few other data structures,
   // for ease of references.
   set<string> direct_includes_;      // key is the quoted include, eg '<set>'
   set<clang::OptionalFileEntryRef> direct_includes_as_fileentries_;
-  set<const clang::NamedDecl*> direct_forward_declares_;
 
   // Holds files forced to be kept.  For example, files included with the
   // "IWYU pragma: keep" comment and x-macros.
@@ -433,8 +468,8 @@ class IwyuFileInfo {
   // Holds files using macros defined in this file.
   set<clang::OptionalFileEntryRef> macro_users_;
 
-  // What we will recommend the #includes to be.
-  set<string> desired_includes_;
+  // Allocated by analysis(), see AnalysisState.
+  unique_ptr<AnalysisState> analysis_;
   bool desired_includes_have_been_calculated_;
 };
 
@@ -450,6 +485,7 @@ class FakeNamedDecl : public clang::NamedDecl {
  public:
   FakeNamedDecl(const string& kind_name, const string& qual_name,
                 const string& decl_filepath, int decl_linenum);
+  ~FakeNamedDecl() override;
 
   string kind_name() const {
     return kind_name_;
@@ -244,4 +244,47 @@ string PathJoin(StringRef dirpath, StringRef relative_path) {
   return string(res);
 }
 
+// Returns the length of the text before the first wildcard in glob, or npos
+// if there is none.
+static size_t GetGlobLiteralPrefixLength(StringRef glob) {
+#if defined(_WIN32)
+  // PathMatchSpec is case-insensitive and takes ';'-separated pattern lists,
+  // so always defer to it.
+  return 0;
+#else
+  return glob.find_first_of("*?[\\");
+#endif
+}
+
+void GlobSet::Insert(StringRef glob) {
+  const size_t prefix_length = GetGlobLiteralPrefixLength(glob);
+  if (prefix_length == StringRef::npos) {
+    literals_.insert(glob);
+    return;
+  }
+  vector<string>& globs = globs_by_prefix_[glob.substr(0, prefix_length)];
+  if (!llvm::is_contained(globs, glob))
+    globs.push_back(glob.str());
+  prefix_lengths_.insert(prefix_length);
+}
+
+bool GlobSet::Matches(StringRef path) const {
+  if (literals_.contains(path))
+    return true;
+
+  const string path_str = path.str();
+  for (size_t prefix_length : prefix_lengths_) {
+    if (prefix_length > path.size())
+      break;
+    auto it = globs_by_prefix_.find(path.substr(0, prefix_length));
+    if (it == globs_by_prefix_.end())
+      continue;
+    for (const string& glob : it->second) {
+      if (GlobMatchesPath(glob.c_str(), path_str.c_str()))
+        return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace include_what_you_use
@@ -12,10 +12,13 @@
 #ifndef INCLUDE_WHAT_YOU_USE_IWYU_PATH_UTIL_H_
 #define INCLUDE_WHAT_YOU_USE_IWYU_PATH_UTIL_H_
 
+#include <set>
 #include <string>                       // for string, allocator, etc
 #include <vector>
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 
 namespace include_what_you_use {
 
@@ -103,6 +106,27 @@ bool IsSpecialFilenameOrStdin(StringRef name);
 // Append path to dirpath.
 string PathJoin(StringRef dirpath, StringRef relative_path);
 
+// A set of glob file-patterns, matched like GlobMatchesPath (they behave just
+// as they do in the shell).  Patterns without wildcards, like the paths of
+// the main compilation unit, are looked up exactly, and the others are only
+// matched against paths that start with their literal prefix.
+class GlobSet {
+ public:
+  void Insert(StringRef glob);
+  bool Matches(StringRef path) const;
+  bool empty() const {
+    return literals_.empty() && globs_by_prefix_.empty();
+  }
+
+ private:
+  // Patterns without wildcards.
+  llvm::StringSet<> literals_;
+  // Patterns with wildcards, keyed by the text before the first wildcard.
+  llvm::StringMap<vector<string>> globs_by_prefix_;
+  // Distinct key lengths in globs_by_prefix_.
+  std::set<size_t> prefix_lengths_;
+};
+
 }  // namespace include_what_you_use
 
 #endif  // INCLUDE_WHAT_YOU_USE_IWYU_PATH_UTIL_H_
@@ -12,7 +12,7 @@
 #include <cstring>
 #include <optional>
 #include <string>                       // for string, basic_string, etc
-#include <utility>                      // for pair, make_pair
+#include <utility>                      // for pair
 
 #include "clang/AST/Decl.h"
 #include "clang/Basic/IdentifierTable.h"
@@ -31,6 +31,7 @@
 #include "iwyu_string_util.h"
 #include "iwyu_verrs.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
 
 // TODO: Clean out pragmas as IWYU improves.
 // IWYU pragma: no_include "clang/Basic/CustomizableOptional.h"
@@ -53,7 +54,6 @@ using clang::SrcMgr::CharacteristicKind;
 using clang::Token;
 using llvm::StringRef;
 using llvm::errs;
-using std::make_pair;
 using std::string;
 
 namespace include_what_you_use {
@@ -229,8 +229,7 @@ void IwyuPreprocessorInfo::HandlePragmaComment(SourceRange comment_range) {
       SourceLocation export_loc_begin = begin_exports_location_stack_.top();
       begin_exports_location_stack_.pop();
       SourceRange export_range(export_loc_begin, begin_loc);
-      export_location_ranges_.insert(
-          std::make_pair(this_file_entry, export_range));
+      export_location_ranges_[this_file_entry].push_back(export_range);
     } else {
       // No pragma allowed within "begin_exports" - "end_exports"
       Warn(begin_loc, "Expected end_exports pragma");
@@ -244,7 +243,7 @@ void IwyuPreprocessorInfo::HandlePragmaComment(SourceRange comment_range) {
       SourceLocation keep_loc_begin = begin_keep_location_stack_.top();
       begin_keep_location_stack_.pop();
       SourceRange keep_range(keep_loc_begin, begin_loc);
-      keep_location_ranges_.insert(std::make_pair(this_file_entry, keep_range));
+      keep_location_ranges_[this_file_entry].push_back(keep_range);
     } else {
       // No pragmas allowed within "begin_keep" - "end_keep"
       Warn(begin_loc, "Expected end_keep pragma");
@@ -366,11 +365,14 @@ void IwyuPreprocessorInfo::ProcessHeadernameDirectivesInFile(
     return;
   }
 
-  SourceLocation current_loc = file_beginning;
-  OptionalFileEntryRef file = GetFileEntry(current_loc);
+  OptionalFileEntryRef file = GetFileEntry(file_beginning);
   if (!file) {
     return;
   }
+  if (!headername_processed_files_.emplace(file, quoted_private_include)
+           .second) {
+    return;
+  }
 
   // Make sure we have a mappable name.
   CHECK_(IsQuotedInclude(quoted_private_include))
@@ -379,19 +381,27 @@ void IwyuPreprocessorInfo::ProcessHeadernameDirectivesInFile(
   // Quote @headername headers based on the current file's system-headerness.
   bool is_angled = IsSystemHeader(file);
 
+  // The directive lives in the file's doc comment, so don't bother searching
+  // past the leading comments.  Most headers have none, and would otherwise
+  // be scanned to the end.
+  const StringRef comments =
+      GetLeadingCommentText(file_beginning, DefaultDataGetter());
+  size_t pos = 0;
   while (true) {
     // Find any headername directive after a file directive. This is a Doxygen
     // convention in libstdc++ to point users from private to public headers.
-    current_loc = GetLocationAfter(current_loc, "@file", DefaultDataGetter());
-    if (!current_loc.isValid()) {
+    static const StringRef kFileDirective = "@file";
+    static const StringRef kHeadernameDirective = "@headername{";
+    pos = comments.find(kFileDirective, pos);
+    if (pos == StringRef::npos) {
       break;
     }
-    current_loc = GetLocationAfter(current_loc,
-                                   "@headername{",
-                                   DefaultDataGetter());
-    if (!current_loc.isValid()) {
+    pos = comments.find(kHeadernameDirective, pos + kFileDirective.size());
+    if (pos == StringRef::npos) {
       break;
     }
+    pos += kHeadernameDirective.size();
+    const SourceLocation current_loc = file_beginning.getLocWithOffset(pos);
 
     string after_text = GetSourceTextUntilEndOfLine(current_loc,
                                                     DefaultDataGetter()).str();
@@ -438,20 +448,16 @@ IwyuFileInfo* IwyuPreprocessorInfo::GetFromFileInfoMap(
   IwyuFileInfo* iwyu_file_info = FindInMap(&iwyu_file_info_map_, file);
   if (!iwyu_file_info) {
     const string quoted_include = ConvertToQuotedInclude(GetFilePath(file));
-    iwyu_file_info_map_.insert(
-        make_pair(file, IwyuFileInfo(file, this, quoted_include)));
-    iwyu_file_info = FindInMap(&iwyu_file_info_map_, file);
-    CHECK_(iwyu_file_info);   // should succeed this time!
+    iwyu_file_info =
+        &iwyu_file_info_map_.emplace(file, file, this, quoted_include)
+             .first->second;
   }
   return iwyu_file_info;
 }
 
 void IwyuPreprocessorInfo::InsertIntoFileInfoMap(
     OptionalFileEntryRef file, const string& quoted_include_name) {
-  if (!FindInMap(&iwyu_file_info_map_, file)) {
-    iwyu_file_info_map_.insert(
-        make_pair(file, IwyuFileInfo(file, this, quoted_include_name)));
-  }
+  iwyu_file_info_map_.emplace(file, file, this, quoted_include_name);
 }
 
 // Sometimes, we can tell just by looking at an #include line
@@ -469,9 +475,7 @@ void IwyuPreprocessorInfo::MaybeProtectInclude(
   // TODO(dsturtevant): As written "// // IWYU pragma: keep" is incorrectly
   // interpreted as a pragma. Maybe do "keep" and "export" pragma handling
   // in HandleComment?
-  if (LineHasText(includer_loc, "// IWYU pragma: keep") ||
-      LineHasText(includer_loc, "/* IWYU pragma: keep") ||
-      HasOpenBeginKeep(includer)) {
+  if (LineHasPragma(includer_loc, "keep") || HasOpenBeginKeep(includer)) {
     protect_reason = "pragma_keep";
     FileInfoFor(includer)->ReportKnownDesiredFile(includee);
 
@@ -480,8 +484,7 @@ void IwyuPreprocessorInfo::MaybeProtectInclude(
     protect_reason = "--keep";
     FileInfoFor(includer)->ReportKnownDesiredFile(includee);
 
-  } else if (LineHasText(includer_loc, "// IWYU pragma: export") ||
-             LineHasText(includer_loc, "/* IWYU pragma: export") ||
+  } else if (LineHasPragma(includer_loc, "export") ||
              HasOpenBeginExports(includer)) {
     protect_reason = "pragma_export";
     const string includer_path = GetFilePath(includer);
@@ -960,6 +963,7 @@ void IwyuPreprocessorInfo::AddAllIncludesAsFileEntries(
 }
 
 void IwyuPreprocessorInfo::PopulateIntendsToProvideMap() {
+  llvm::TimeTraceScope trace_scope("IWYU PopulateIntendsToProvideMap");
   CHECK_(intends_to_provide_map_.empty() && "Should only call this fn once");
   // Figure out which of the header files we have are public.  We'll
   // map each one to a set of all private header files that map to it.
@@ -1059,12 +1063,28 @@ void IwyuPreprocessorInfo::PopulateIntendsToProvideMap() {
 }
 
 void IwyuPreprocessorInfo::PopulateTransitiveIncludeMap() {
+  llvm::TimeTraceScope trace_scope("IWYU PopulateTransitiveIncludeMap");
   CHECK_(transitive_include_map_.empty() && "Should only call this fn once");
   for (const auto& fileinfo : iwyu_file_info_map_) {
     OptionalFileEntryRef file = fileinfo.first;
     transitive_include_map_[file].insert(file);   // everyone includes itself!
     AddAllIncludesAsFileEntries(file, &transitive_include_map_[file]);
   }
+
+  // Index the files by quoted include, keys before other includees.
+  set<OptionalFileEntryRef> indexed;
+  auto index = [&](OptionalFileEntryRef file) {
+    if (indexed.insert(file).second) {
+      files_by_quoted_include_[ConvertToQuotedInclude(GetFilePath(file))]
+          .push_back(file);
+    }
+  };
+  for (const auto& entry : transitive_include_map_)
+    index(entry.first);
+  for (const auto& entry : transitive_include_map_) {
+    for (OptionalFileEntryRef include : entry.second)
+      index(include);
+  }
 }
 
 //------------------------------------------------------------
@@ -1104,8 +1124,9 @@ bool IwyuPreprocessorInfo::BelongsToMainCompilationUnit(
   // In the case of pch-in-code make this the *second* include,
   // as the PCH must always be first.
   int first_include_index = GlobalFlags().pch_in_code ? 2 : 1;
-  if (includer == main_file_ &&
-      ContainsKeyValue(num_includes_seen_, includer, first_include_index)) {
+  const int* num_includes = FindInMap(&num_includes_seen_, includer);
+  if (includer == main_file_ && num_includes != nullptr &&
+      *num_includes == first_include_index) {
     if (GetCanonicalName(Basename(GetFilePath(includee))) ==
         GetCanonicalName(Basename(GetFilePath(main_file_))))
       return true;
@@ -1132,6 +1153,11 @@ bool IwyuPreprocessorInfo::PublicHeaderIntendsToProvide(
   return false;
 }
 
+const set<OptionalFileEntryRef>* IwyuPreprocessorInfo::TransitiveIncludesOf(
+    OptionalFileEntryRef file) const {
+  return FindInMap(&transitive_include_map_, file);
+}
+
 bool IwyuPreprocessorInfo::FileTransitivelyIncludes(
     OptionalFileEntryRef includer, OptionalFileEntryRef includee) const {
   if (const set<OptionalFileEntryRef>* all_includes =
@@ -1143,21 +1169,29 @@ bool IwyuPreprocessorInfo::FileTransitivelyIncludes(
 
 bool IwyuPreprocessorInfo::FileTransitivelyIncludes(
     OptionalFileEntryRef includer, const string& quoted_includee) const {
-  if (const set<OptionalFileEntryRef>* all_includes =
-          FindInMap(&transitive_include_map_, includer)) {
-    for (OptionalFileEntryRef include : *all_includes) {
-      if (ConvertToQuotedInclude(GetFilePath(include)) == quoted_includee)
-        return true;
-    }
+  const set<OptionalFileEntryRef>* all_includes =
+      FindInMap(&transitive_include_map_, includer);
+  auto files = files_by_quoted_include_.find(quoted_includee);
+  if (all_includes == nullptr || files == files_by_quoted_include_.end())
+    return false;
+  for (OptionalFileEntryRef includee : files->second) {
+    if (ContainsKey(*all_includes, includee))
+      return true;
   }
   return false;
 }
 
 bool IwyuPreprocessorInfo::FileTransitivelyIncludes(
     const string& quoted_includer, OptionalFileEntryRef includee) const {
-  for (const auto& entry : transitive_include_map_) {
-    if (ConvertToQuotedInclude(GetFilePath(entry.first)) == quoted_includer)
-      return ContainsKey(entry.second, includee);
+  auto files = files_by_quoted_include_.find(quoted_includer);
+  if (files == files_by_quoted_include_.end())
+    return false;
+  // Like a scan of transitive_include_map_, use the first includer found.
+  for (OptionalFileEntryRef includer : files->second) {
+    if (const set<OptionalFileEntryRef>* all_includes =
+            FindInMap(&transitive_include_map_, includer)) {
+      return ContainsKey(*all_includes, includee);
+    }
   }
   return false;
 }
@@ -1186,15 +1220,16 @@ bool IwyuPreprocessorInfo::ForwardDeclareIsMarkedKeep(
 
   // Is the decl part of a begin_keep/end_keep block?
   OptionalFileEntryRef file = GetFileEntry(loc);
-  auto keep_ranges = keep_location_ranges_.equal_range(file);
-  for (auto it = keep_ranges.first; it != keep_ranges.second; ++it) {
-    if (it->second.fullyContains(loc)) {
-      return true;
+  if (const vector<SourceRange>* keep_ranges =
+          FindInMap(&keep_location_ranges_, file)) {
+    for (const SourceRange& keep_range : *keep_ranges) {
+      if (keep_range.fullyContains(loc)) {
+        return true;
+      }
     }
   }
   // Is the declaration itself marked with trailing comment?
-  return (LineHasText(loc, "// IWYU pragma: keep") ||
-          LineHasText(loc, "/* IWYU pragma: keep"));
+  return LineHasPragma(loc, "keep");
 }
 
 bool IwyuPreprocessorInfo::ForwardDeclareIsExported(
@@ -1206,14 +1241,15 @@ bool IwyuPreprocessorInfo::ForwardDeclareIsExported(
 
   // Is the decl part of a begin_exports/end_exports block?
   OptionalFileEntryRef file = GetFileEntry(loc);
-  auto export_ranges = export_location_ranges_.equal_range(file);
-  for (auto it = export_ranges.first; it != export_ranges.second; ++it) {
-    if (it->second.fullyContains(loc)) {
-      return true;
+  if (const vector<SourceRange>* export_ranges =
+          FindInMap(&export_location_ranges_, file)) {
+    for (const SourceRange& export_range : *export_ranges) {
+      if (export_range.fullyContains(loc)) {
+        return true;
+      }
     }
   }
   // Is the declaration itself marked with trailing comment?
-  return (LineHasText(loc, "// IWYU pragma: export") ||
-          LineHasText(loc, "/* IWYU pragma: export"));
+  return LineHasPragma(loc, "export");
 }
 }  // namespace include_what_you_use
@@ -43,7 +43,8 @@
 // 4) Process doxygen @headername directives. In later versions of GCC,
 //    these directives are like IWYU pragma private directives:
 //    @headername{foo} means to include <foo> instead.
-//    The arguments are allowed to be a comma-separated list.
+//    The arguments are allowed to be a comma-separated list.  Only the
+//    leading comment block of a file is searched for the directive.
 //    See
 //    http://gcc.gnu.org/onlinedocs/libstdc++/manual/documentation_hacking.html
 //
@@ -64,6 +65,7 @@
 #include <set>                          // for set
 #include <stack>                        // for stack
 #include <string>                       // for string
+#include <utility>                      // for pair
 #include <vector>                       // for vector
 
 #include "clang/Basic/FileEntry.h"
@@ -71,7 +73,9 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Preprocessor.h"
+#include "iwyu_location_util.h"
 #include "iwyu_output.h"
+#include "llvm/ADT/StringMap.h"
 
 namespace clang {
 class NamedDecl;
@@ -84,7 +88,7 @@ using std::set;
 using std::stack;
 using std::string;
 using std::vector;
-using std::multimap;
+using std::pair;
 
 class IwyuPreprocessorInfo : public clang::PPCallbacks,
                              public clang::CommentHandler {
@@ -153,6 +157,11 @@ class IwyuPreprocessorInfo : public clang::PPCallbacks,
   bool FileTransitivelyIncludes(const string& quoted_includer,
                                 clang::OptionalFileEntryRef includee) const;
 
+  // Returns all files the given file directly or indirectly includes,
+  // including the file itself, or nullptr if the file wasn't seen.
+  const set<clang::OptionalFileEntryRef>* TransitiveIncludesOf(
+      clang::OptionalFileEntryRef file) const;
+
   // Return true if the given file has
   // "// IWYU pragma: no_include <other_filename>".
   bool IncludeIsInhibited(clang::OptionalFileEntryRef file,
@@ -301,10 +310,12 @@ class IwyuPreprocessorInfo : public clang::PPCallbacks,
   // #include.
   map<string, clang::OptionalFileEntryRef> include_to_fileentry_map_;
 
-  map<clang::OptionalFileEntryRef, IwyuFileInfo> iwyu_file_info_map_;
+  // The per-file maps below are FileMaps, indexed by the files' unique
+  // IDs, as they're looked up for nearly every use and #include.
+  FileMap<IwyuFileInfo> iwyu_file_info_map_;
 
   // How many #include lines we've encountered from the given file.
-  map<clang::OptionalFileEntryRef, int> num_includes_seen_;
+  FileMap<int> num_includes_seen_;
 
   // Maps from a FileEntry to all files that this file "intends" to
   // provide the symbols from.  For now, we say a file intentionally
@@ -315,22 +326,26 @@ class IwyuPreprocessorInfo : public clang::PPCallbacks,
   // or indirectly included by the public file.  This isn't perfect,
   // but is as close as we can be to matching the intent of the author
   // of the public/private system.
-  map<clang::OptionalFileEntryRef, set<clang::OptionalFileEntryRef>>
-      intends_to_provide_map_;
+  FileMap<set<clang::OptionalFileEntryRef>> intends_to_provide_map_;
 
   // Maps from a FileEntry to all the files that this file includes,
   // either directly or indirectly.
-  map<clang::OptionalFileEntryRef, set<clang::OptionalFileEntryRef>>
-      transitive_include_map_;
+  FileMap<set<clang::OptionalFileEntryRef>> transitive_include_map_;
+
+  // Maps a quoted include to the files in transitive_include_map_ (keys
+  // first, in map order, then the other includees) with that name, so
+  // that the quoted-include FileTransitivelyIncludes overloads don't have
+  // to convert every file path on every query.
+  llvm::StringMap<vector<clang::OptionalFileEntryRef>> files_by_quoted_include_;
 
   // Maps from a FileEntry to the quoted names of files that its file
   // is directed *not* to include via the "no_include" pragma.
-  map<clang::OptionalFileEntryRef, set<string>> no_include_map_;
+  FileMap<set<string>> no_include_map_;
 
   // Maps from a FileEntry to the qualified names of symbols that its
   // file is directed *not* to forward-declare via the
   // "no_forward_declare" pragma.
-  map<clang::OptionalFileEntryRef, set<string>> no_forward_declare_map_;
+  FileMap<set<string>> no_forward_declare_map_;
 
   // For processing pragmas. It is the current stack of open
   // "begin_exports".  There should be at most one item in this stack
@@ -342,15 +357,13 @@ class IwyuPreprocessorInfo : public clang::PPCallbacks,
   // inclusion chain.
   stack<clang::SourceLocation> begin_keep_location_stack_;
 
-  // For processing forward decls. It is a multimap containing the bounds of
-  // every keep range.
-  multimap<clang::OptionalFileEntryRef, clang::SourceRange>
-      keep_location_ranges_;
+  // For processing forward decls. It holds the bounds of every keep range,
+  // by file.
+  FileMap<vector<clang::SourceRange>> keep_location_ranges_;
 
-  // For processing forward decls. It is a multimap containing the bounds of
-  // every export range.
-  multimap<clang::OptionalFileEntryRef, clang::SourceRange>
-      export_location_ranges_;
+  // For processing forward decls. It holds the bounds of every export range,
+  // by file.
+  FileMap<vector<clang::SourceRange>> export_location_ranges_;
 
   // For processing associated pragma. It is the current open
   // "associated" pragma.
@@ -366,6 +379,11 @@ class IwyuPreprocessorInfo : public clang::PPCallbacks,
   // Keeps track of which files have the "always_keep" pragma, so they can be
   // marked as such for all includers.
   std::set<clang::OptionalFileEntryRef> always_keep_files_;
+
+  // Files already searched for @headername directives, with the include
+  // name they were mapped from.  Files without include guards are entered
+  // many times, but need only be searched once.
+  set<pair<clang::OptionalFileEntryRef, string>> headername_processed_files_;
 };
 
 }  // namespace include_what_you_use
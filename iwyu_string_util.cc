@@ -0,0 +1,34 @@
+//===--- iwyu_string_util.cc - string utilities for include-what-you-use --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "iwyu_string_util.h"
+
+namespace include_what_you_use {
+
+using std::optional;
+
+InternedString StringInterner::Intern(StringRef str) {
+  if (str.empty())
+    return InternedString();
+  auto it = strings_.find(str);
+  if (it == strings_.end())
+    it = strings_.insert(str.str()).first;
+  return InternedString(&*it);
+}
+
+optional<InternedString> StringInterner::Find(StringRef str) const {
+  if (str.empty())
+    return InternedString();
+  auto it = strings_.find(str);
+  if (it == strings_.end())
+    return std::nullopt;
+  return InternedString(&*it);
+}
+
+}  // namespace include_what_you_use
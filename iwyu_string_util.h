@@ -15,11 +15,15 @@
 
 #include <cctype>
 #include <ctime>
+#include <functional>
+#include <optional>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "iwyu_port.h"
+#include "llvm/ADT/DenseMapInfo.h"
 #include "llvm/ADT/StringRef.h"
 
 namespace include_what_you_use {
@@ -199,6 +203,65 @@ inline vector<string> SplitOnWhiteSpacePreservingQuotes(StringRef str,
   return retval;
 }
 
+// A handle to a string interned by a StringInterner.  Handles are as
+// cheap to copy as a pointer, and are compared and hashed by address, so
+// containers of them don't iterate in the order of the strings.  A handle
+// is valid as long as the interner that made it.
+class InternedString {
+ public:
+  // The empty string.
+  InternedString() : str_(nullptr) {
+  }
+
+  const string& str() const {
+    static const string* const empty = new string;
+    return str_ ? *str_ : *empty;
+  }
+  operator const string&() const {
+    return str();
+  }
+  bool empty() const {
+    return str().empty();
+  }
+
+  friend bool operator==(InternedString a, InternedString b) {
+    return a.str_ == b.str_;
+  }
+  friend bool operator!=(InternedString a, InternedString b) {
+    return a.str_ != b.str_;
+  }
+  friend bool operator<(InternedString a, InternedString b) {
+    return std::less<const string*>()(a.str_, b.str_);
+  }
+
+ private:
+  friend class StringInterner;
+  friend struct llvm::DenseMapInfo<InternedString>;
+
+  explicit InternedString(const string* str) : str_(str) {
+  }
+
+  const string* str_;
+};
+
+// Stores each distinct string once, and hands out InternedStrings for
+// them.  It is not thread-safe: an owner that is shared between threads
+// has to intern before it is, and only look strings up afterwards.
+class StringInterner {
+ public:
+  InternedString Intern(StringRef str);
+
+  // Returns the handle for str if it is interned already, without
+  // interning it otherwise.  Lookups of strings that aren't used anywhere
+  // can tell they match nothing this way.
+  std::optional<InternedString> Find(StringRef str) const;
+
+ private:
+  // std::set never moves its elements, so handles stay valid as it grows.
+  // The transparent comparator allows lookups by StringRef.
+  std::set<string, std::less<>> strings_;
+};
+
 inline string FormatISO8601(time_t t) {
   char buf[32];
   strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
@@ -207,4 +270,28 @@ inline string FormatISO8601(time_t t) {
 
 }  // namespace include_what_you_use
 
+namespace llvm {
+
+// Lets InternedStrings, and pairs of them, key DenseMaps and DenseSets.
+template <>
+struct DenseMapInfo<include_what_you_use::InternedString> {
+  using InternedString = include_what_you_use::InternedString;
+  using StringPtrInfo = DenseMapInfo<const std::string*>;
+
+  static InternedString getEmptyKey() {
+    return InternedString(StringPtrInfo::getEmptyKey());
+  }
+  static InternedString getTombstoneKey() {
+    return InternedString(StringPtrInfo::getTombstoneKey());
+  }
+  static unsigned getHashValue(InternedString str) {
+    return StringPtrInfo::getHashValue(str.str_);
+  }
+  static bool isEqual(InternedString a, InternedString b) {
+    return a == b;
+  }
+};
+
+}  // namespace llvm
+
 #endif  // INCLUDE_WHAT_YOU_USE_IWYU_STRING_UTIL_H_
@@ -47,6 +47,8 @@ _ACTUAL_SUMMARY_START_RE = re.compile(r'^(.*?) should add these lines:$')
 _ACTUAL_SUMMARY_END_RE = re.compile(r'^---$')
 _ACTUAL_REMOVAL_LIST_START_RE = re.compile(r'.* should remove these lines:$')
 _NODIFFS_RE = re.compile(r'^\((.*?) has correct #includes/fwd-decls\)$')
+# With --check_only, files with diffs get a one-line summary too.
+_CHECK_ONLY_RE = re.compile(r'^\((.*?) has iwyu violations\)$')
 
 # This is an IWYU_ARGS line that specifies launch arguments for a test in its
 # source file. Example:
@@ -448,7 +450,7 @@ def _GetActualSummaries(output):
   in_addition_section = False  # Are we in the "should add these lines" section?
   for line in output:
     # For files with no diffs, we print a different (one-line) summary.
-    m = _NODIFFS_RE.match(line)
+    m = _NODIFFS_RE.match(line) or _CHECK_ONLY_RE.match(line)
     if m:
       actual_summaries[m.group(1)] = [line]
       continue
@@ -238,17 +238,54 @@ def find_include_what_you_use():
 IWYU_EXECUTABLE = find_include_what_you_use()
 
 
+def exit_code_from_wait_status(status):
+    """ Convert an os.wait()-style status to a Popen-style return code. """
+    if os.WIFSIGNALED(status):
+        return -os.WTERMSIG(status)
+    return os.WEXITSTATUS(status)
+
+
 class Process(object):
     """ Manages an IWYU process in flight """
     def __init__(self, proc, outfile):
         self.proc = proc
         self.outfile = outfile
         self.output = None
+        self.start_time = time.time()
+        # Set when the process completes. Peak RSS is in bytes, and only
+        # available on platforms with os.wait4.
+        self.duration = None
+        self.max_rss = None
+
+    def _reap(self, options):
+        """ Wait for the process with os.wait4, to also get its peak RSS. """
+        pid, status, rusage = os.wait4(self.proc.pid, options)
+        if pid == 0:
+            return
+        self.proc.returncode = exit_code_from_wait_status(status)
+        self.duration = time.time() - self.start_time
+        # ru_maxrss is in bytes on macOS, in kilobytes elsewhere.
+        scale = 1 if sys.platform == 'darwin' else 1024
+        self.max_rss = rusage.ru_maxrss * scale
 
     def poll(self):
         """ Return the exit code if the process has completed, None otherwise.
         """
-        return self.proc.poll()
+        if self.proc.returncode is None:
+            if hasattr(os, 'wait4'):
+                self._reap(os.WNOHANG)
+            elif self.proc.poll() is not None:
+                self.duration = time.time() - self.start_time
+        return self.proc.returncode
+
+    def wait(self):
+        """ Block until the process has completed. """
+        if self.proc.returncode is None:
+            if hasattr(os, 'wait4'):
+                self._reap(0)
+            else:
+                self.proc.wait()
+                self.duration = time.time() - self.start_time
 
     @property
     def returncode(self):
@@ -260,7 +297,7 @@ class Process(object):
         This call blocks until the process is complete, then returns the output.
         """
         if not self.output:
-            self.proc.wait()
+            self.wait()
             self.outfile.seek(0)
             self.output = self.outfile.read().decode("utf-8")
             self.outfile.close()
@@ -286,9 +323,15 @@ KNOWN_COMPILER_WRAPPERS=frozenset([
 
 class Invocation(object):
     """ Holds arguments of an IWYU invocation. """
-    def __init__(self, command, cwd):
+    def __init__(self, command, cwd, key=None):
         self.command = command
         self.cwd = cwd
+        # Identifies the invocation in the run history.
+        self.key = key
+        # Predicted duration (in seconds) and peak RSS (in bytes), see
+        # predict_costs.
+        self.cost = 1.0
+        self.max_rss = 0
 
     def __str__(self):
         return ' '.join(self.command)
@@ -316,7 +359,7 @@ class Invocation(object):
             extra_args = ['--driver-mode=cl'] + extra_args
 
         command = [IWYU_EXECUTABLE] + extra_args + compile_args
-        return cls(command, entry['directory'])
+        return cls(command, entry['directory'], entry.get('file'))
 
     def start(self, verbose):
         """ Run invocation and collect output. """
@@ -402,24 +445,124 @@ def worst_exit_code(worst, cur):
         return max(worst, cur)
 
 
-def execute(invocations, verbose, formatter, jobs, max_load_average=0):
-    """ Launch processes described by invocations. """
+def load_history(path):
+    """ Return the run history stored at path, or an empty one.
+
+    The history maps invocation keys (source file paths) to the 'duration'
+    in seconds and peak RSS ('max_rss') in bytes of their last run.
+    """
+    try:
+        with open(path, 'r') as fileobj:
+            history = json.load(fileobj)
+    except (IOError, ValueError):
+        return {}
+
+    if not isinstance(history, dict):
+        return {}
+    return history
+
+
+def save_history(path, history):
+    """ Write the run history to path, atomically replacing the old one. """
+    dirname = os.path.dirname(os.path.abspath(path))
+    with tempfile.NamedTemporaryFile('w', dir=dirname, prefix='iwyu',
+                                     delete=False) as fileobj:
+        json.dump(history, fileobj, indent=1, sort_keys=True)
+    os.replace(fileobj.name, path)
+
+
+def record_cost(history, invocation, proc):
+    """ Record the measured cost of a completed process in history. """
+    if history is None or invocation.key is None or proc.duration is None:
+        return
+
+    record = {'duration': round(proc.duration, 3)}
+    if proc.max_rss is not None:
+        record['max_rss'] = proc.max_rss
+    history[invocation.key] = record
+
+
+def predict_costs(invocations, history):
+    """ Set predicted cost and peak RSS of invocations from history.
+
+    Invocations without history are predicted to cost the average of those
+    with history.
+    """
+    known = [history[i.key] for i in invocations if i.key in history]
+    durations = [r['duration'] for r in known if 'duration' in r]
+    rss_values = [r['max_rss'] for r in known if 'max_rss' in r]
+    default_duration = sum(durations) / len(durations) if durations else 1.0
+    default_rss = sum(rss_values) // len(rss_values) if rss_values else 0
+
+    for invocation in invocations:
+        record = history.get(invocation.key, {})
+        invocation.cost = record.get('duration', default_duration)
+        invocation.max_rss = record.get('max_rss', default_rss)
+
+
+def longest_first(invocations):
+    """ Return invocations ordered by descending predicted cost.
+
+    Starting the expensive ones first keeps them from stretching the tail of a
+    parallel run. The sort is stable, so without history the order is kept.
+    """
+    return sorted(invocations, key=lambda i: -i.cost)
+
+
+def shard_invocations(invocations, index, count):
+    """ Return the invocations of shard index (1-based) out of count.
+
+    Invocations are assigned greedily, most expensive first, to the shard with
+    the least predicted cost so far. All shards must use the same history to
+    agree on the partition.
+    """
+    loads = [0.0] * count
+    shards = [[] for _ in range(count)]
+    for invocation in longest_first(invocations):
+        shard = min(range(count), key=lambda n: (loads[n], n))
+        shards[shard].append(invocation)
+        loads[shard] += invocation.cost
+
+    # Keep the original order within the shard.
+    selected = set(id(i) for i in shards[index - 1])
+    return [i for i in invocations if id(i) in selected]
+
+
+def print_report(invocation, output):
+    """ Default report callback for execute: print the formatted output. """
+    print(output)
+
+
+def execute(invocations, verbose, formatter, jobs, max_load_average=0,
+            memory_budget=0, history=None, report=print_report):
+    """ Launch processes described by invocations.
+
+    If memory_budget is nonzero, a new process is only started if the
+    predicted peak RSS of it and all running processes fits in the budget (in
+    bytes), or if none is running. Measured costs are recorded in history,
+    unless it's None. The formatted output of each completed invocation is
+    passed to report(invocation, output).
+    """
     exit_code = 0
     if jobs == 1:
         for invocation in invocations:
             proc = invocation.start(verbose)
-            print(formatter(proc.get_output()))
+            report(invocation, formatter(proc.get_output()))
             exit_code = worst_exit_code(exit_code, proc.returncode)
+            record_cost(history, invocation, proc)
         return exit_code
 
     pending = []
+    started_from = {}
     while invocations or pending:
         # Collect completed IWYU processes and print results.
         complete = [proc for proc in pending if proc.poll() is not None]
         for proc in complete:
             pending.remove(proc)
-            print(formatter(proc.get_output()))
+            invocation = started_from.pop(proc)
+            report(invocation, formatter(proc.get_output()))
             exit_code = worst_exit_code(exit_code, proc.returncode)
+            record_cost(history, invocation, proc)
 
         # Schedule new processes if there's room.
         capacity = jobs - len(pending)
@@ -435,7 +578,21 @@ def execute(invocations, verbose, formatter, jobs, max_load_average=0):
                     # Ensure there is at least one job running.
                     capacity = 1
 
-        pending.extend(i.start(verbose) for i in invocations[:capacity])
+        if memory_budget > 0:
+            in_use = sum(started_from[proc].max_rss for proc in pending)
+            admitted = 0
+            for invocation in invocations[:capacity]:
+                if pending or admitted:
+                    if in_use + invocation.max_rss > memory_budget:
+                        break
+                in_use += invocation.max_rss
+                admitted += 1
+            capacity = admitted
+
+        for invocation in invocations[:capacity]:
+            proc = invocation.start(verbose)
+            started_from[proc] = invocation
+            pending.append(proc)
         invocations = invocations[capacity:]
 
         # Yield CPU between job polls.
@@ -443,6 +600,112 @@ def execute(invocations, verbose, formatter, jobs, max_load_average=0):
     return exit_code
 
 
+def read_dependencies(path, cwd):
+    """ Return the files listed in an IWYU --dependency_file.
+
+    Relative paths are resolved against cwd, the directory IWYU ran in. A
+    missing file (e.g. IWYU crashed) yields no dependencies.
+    """
+    try:
+        with open(path, 'r') as fileobj:
+            lines = fileobj.read().splitlines()
+    except (IOError, OSError):
+        return set()
+
+    return set(os.path.normpath(os.path.join(cwd, line))
+               for line in lines if line)
+
+
+def file_mtimes(paths):
+    """ Return a map from each path to its modification time, or None if the
+    file doesn't exist. """
+    mtimes = {}
+    for path in paths:
+        try:
+            mtimes[path] = os.stat(path).st_mtime_ns
+        except OSError:
+            mtimes[path] = None
+    return mtimes
+
+
+def affected_invocations(invocations, dependencies, changed):
+    """ Return the invocations that depend on any of the changed files.
+
+    dependencies maps each invocation to the set of files it depends on.
+    """
+    return [i for i in invocations if dependencies[i] & changed]
+
+
+def watch(invocations, verbose, formatter, jobs, max_load_average=0,
+          memory_budget=0, history=None, history_path=None, interval=1.0):
+    """ Launch invocations, then re-launch the ones that depend on a file
+    whenever it changes, until interrupted.
+
+    Dependencies are what IWYU reports with --dependency_file: the include
+    graph of each translation unit as it changes, and the mapping files it
+    uses. Each re-run is a new IWYU process, so nothing is cached between
+    runs. Output is only printed when it differs from the previous run of
+    the same invocation.
+    memory_budget and history are as for execute, and the history is saved
+    to history_path after every run.
+    """
+    depdir = tempfile.mkdtemp(prefix='iwyu')
+    depfiles = {}
+    for n, invocation in enumerate(invocations):
+        depfiles[invocation] = os.path.join(depdir, '%d.deps' % n)
+        invocation.command = invocation.command + [
+            '-Xiwyu', '--dependency_file=' + depfiles[invocation]]
+
+    outputs = {}
+
+    def report_delta(invocation, output):
+        if outputs.get(invocation) != output:
+            print(output)
+        elif verbose:
+            print('# %s: no change' % invocation.key, file=sys.stderr)
+        outputs[invocation] = output
+        sys.stdout.flush()
+
+    dependencies = dict((i, set()) for i in invocations)
+    mtimes = {}
+    pending = invocations
+    try:
+        while True:
+            # Snapshot before running, so that edits made while IWYU runs
+            # trigger another run.
+            known = set().union(*dependencies.values())
+            mtimes.update(file_mtimes(known))
+            # Predict from the costs measured in earlier runs too.
+            if history is not None:
+                predict_costs(invocations, history)
+            execute(pending, verbose, formatter, jobs, max_load_average,
+                    memory_budget, history, report=report_delta)
+            if history_path:
+                save_history_or_warn(history_path, history)
+            for invocation in pending:
+                dependencies[invocation] = read_dependencies(
+                    depfiles[invocation], invocation.cwd)
+                # In case IWYU failed before writing the dependencies.
+                if invocation.key:
+                    dependencies[invocation].add(os.path.normpath(
+                        os.path.join(invocation.cwd, invocation.key)))
+                mtimes.update(file_mtimes(dependencies[invocation] - known))
+
+            pending = []
+            while not pending:
+                time.sleep(interval)
+                current = file_mtimes(set().union(*dependencies.values()))
+                changed = set(path for path, mtime in current.items()
+                              if mtime != mtimes.get(path))
+                mtimes.update(current)
+                pending = affected_invocations(invocations, dependencies,
+                                               changed)
+    except KeyboardInterrupt:
+        return 0
+    finally:
+        shutil.rmtree(depdir, ignore_errors=True)
+
+
 def _strip_trailing_commas(text):
     """ Strip trailing commas before ] and } outside of JSON strings. """
     result = []
@@ -502,8 +765,17 @@ def json_load_tolerant(fileobj):
         return json.loads(repaired)
 
 
+def save_history_or_warn(path, history):
+    """ Save history to path, only warning if that fails. """
+    try:
+        save_history(path, history)
+    except (IOError, OSError) as why:
+        print('warning: failed to write history: %s' % why, file=sys.stderr)
+
+
 def main(compilation_db_path, source_files, exclude, verbose, formatter, jobs,
-         max_load_average, extra_args):
+         max_load_average, extra_args, history_path=None, memory_budget=0,
+         shard=None, watch_files=False):
     """ Entry point. """
 
     if not IWYU_EXECUTABLE:
@@ -533,7 +805,36 @@ def main(compilation_db_path, source_files, exclude, verbose, formatter, jobs,
         Invocation.from_compile_command(e, extra_args) for e in compilation_db
     ]
 
-    return execute(invocations, verbose, formatter, jobs, max_load_average)
+    history = load_history(history_path) if history_path else None
+    predict_costs(invocations, history or {})
+    if shard:
+        invocations = shard_invocations(invocations, *shard)
+    if jobs > 1:
+        invocations = longest_first(invocations)
+
+    if watch_files:
+        return watch(invocations, verbose, formatter, jobs, max_load_average,
+                     memory_budget, history, history_path)
+
+    exit_code = execute(invocations, verbose, formatter, jobs,
+                        max_load_average, memory_budget, history)
+
+    if history_path:
+        save_history_or_warn(history_path, history)
+    return exit_code
+
+
+def parse_shard(value):
+    """ Parse a shard specification 'i/n' into a tuple (i, n). """
+    match = re.match(r'^([0-9]+)/([0-9]+)$', value)
+    if not match:
+        raise argparse.ArgumentTypeError("expected '<i>/<n>', got '%s'" % value)
+
+    index, count = int(match.group(1)), int(match.group(2))
+    if not 1 <= index <= count:
+        raise argparse.ArgumentTypeError(
+            'shard index must be between 1 and %d, got %d' % (count, index))
+    return index, count
 
 
 def _bootstrap(sys_argv):
@@ -580,6 +881,27 @@ def _bootstrap(sys_argv):
     parser.add_argument('-l', '--load', type=float, default=0,
                         help=('Do not start new jobs if the 1min load average '
                               'is greater than the provided value'))
+    parser.add_argument('--history', metavar='<file>', dest='history_path',
+                        help=('Record the duration and peak memory use of '
+                              'each run in this file, and use it to start '
+                              'the most expensive source files first'))
+    parser.add_argument('--memory-budget', metavar='<MiB>', type=float,
+                        default=0,
+                        help=('Do not start new jobs if the peak memory use '
+                              'of the running ones, as predicted by '
+                              '--history, would exceed this value'))
+    parser.add_argument('--shard', metavar='<i>/<n>', type=parse_shard,
+                        help=('Only run IWYU on the i:th of n shards (1-based) '
+                              'of the source files, balanced by the cost '
+                              'predicted by --history. All shards must use '
+                              'the same history file'))
+    parser.add_argument('--watch', action='store_true', dest='watch_files',
+                        help=('Keep running, and re-run IWYU on the source '
+                              'files that include a file, or use a mapping '
+                              'file, whenever it changes. Each re-run starts '
+                              'a new IWYU process per source file, so no '
+                              'analysis is cached between runs. Only changed '
+                              'results are printed'))
     parser.add_argument('-p', metavar='<build-path>', required=True,
                         help='Compilation database path', dest='dbpath')
     parser.add_argument('-e', '--exclude', action='append', default=[],
@@ -604,8 +926,12 @@ def _bootstrap(sys_argv):
     if jobs == 0:
         jobs = os.cpu_count() or 1
 
+    memory_budget = int(args.memory_budget * 1024 * 1024)
+
     return main(args.dbpath, args.source, args.exclude, args.verbose,
-                FORMATTERS[args.output_format], jobs, args.load, extra_args)
+                FORMATTERS[args.output_format], jobs, args.load, extra_args,
+                args.history_path, memory_budget, args.shard,
+                args.watch_files)
 
 
 if __name__ == '__main__':
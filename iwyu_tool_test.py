@@ -14,6 +14,7 @@ import time
 import json
 import random
 import inspect
+import tempfile
 import unittest
 import iwyu_tool
 
@@ -28,6 +29,8 @@ class MockProcess(object):
         self.content = content
         self.complete_ts = time.time() + block
         self.returncode = returncode
+        self.duration = block
+        self.max_rss = None
 
     def poll(self):
         if time.time() < self.complete_ts:
@@ -215,6 +218,155 @@ class IWYUToolTests(unittest.TestCase):
             invocation.will_returncode(exit_code)
         self.assertEqual(self._execute(invocations), -1)
 
+    def test_predict_costs(self):
+        invocations = [MockInvocation() for _ in range(3)]
+        for n, invocation in enumerate(invocations):
+            invocation.key = 'file%d.cc' % n
+        history = {
+            'file0.cc': {'duration': 2.0, 'max_rss': 100},
+            'file1.cc': {'duration': 4.0, 'max_rss': 300},
+        }
+        iwyu_tool.predict_costs(invocations, history)
+        self.assertEqual([2.0, 4.0, 3.0], [i.cost for i in invocations])
+        # Entries without history are predicted to cost the average.
+        self.assertEqual([100, 300, 200], [i.max_rss for i in invocations])
+
+    def test_longest_first(self):
+        invocations = [MockInvocation() for _ in range(4)]
+        for invocation, cost in zip(invocations, [1.0, 3.0, 2.0, 3.0]):
+            invocation.cost = cost
+        ordered = iwyu_tool.longest_first(invocations)
+        # Equal costs keep their relative order.
+        self.assertEqual([invocations[1], invocations[3], invocations[2],
+                          invocations[0]], ordered)
+
+    def test_shard_invocations(self):
+        invocations = [MockInvocation() for _ in range(5)]
+        for invocation, cost in zip(invocations, [5.0, 1.0, 4.0, 2.0, 3.0]):
+            invocation.cost = cost
+        shards = [iwyu_tool.shard_invocations(invocations, n, 2)
+                  for n in (1, 2)]
+        # Every invocation ends up in exactly one shard, in original order.
+        self.assertEqual(
+            [invocations[0], invocations[1], invocations[3]], shards[0])
+        self.assertEqual([invocations[2], invocations[4]], shards[1])
+
+    def test_shard_invocations_without_history(self):
+        invocations = [MockInvocation() for _ in range(5)]
+        shards = [iwyu_tool.shard_invocations(invocations, n, 3)
+                  for n in (1, 2, 3)]
+        self.assertEqual([2, 2, 1], [len(shard) for shard in shards])
+        self.assertEqual(set(invocations), set(sum(shards, [])))
+
+    def test_memory_budget(self):
+        invocations = [MockInvocation() for _ in range(3)]
+        for n, invocation in enumerate(invocations):
+            invocation.will_return('BAR%d' % n)
+            invocation.max_rss = 60
+        invocations[0].will_block(0.05)
+        formatter = iwyu_tool.FORMATTERS[iwyu_tool.DEFAULT_FORMAT]
+        iwyu_tool.execute(invocations, False, formatter, 3, memory_budget=100)
+        # Only one invocation fits in the budget at a time, so the slow first
+        # one holds up the others.
+        self.assertEqual(['BAR0', 'BAR1', 'BAR2'],
+                         self.stdout_stub.getvalue().splitlines())
+
+    def test_history_recorded(self):
+        invocations = [MockInvocation() for _ in range(2)]
+        for n, invocation in enumerate(invocations):
+            invocation.key = 'file%d.cc' % n
+            invocation.will_block(0.01 * (n + 1))
+        history = {}
+        formatter = iwyu_tool.FORMATTERS[iwyu_tool.DEFAULT_FORMAT]
+        iwyu_tool.execute(invocations, False, formatter, 2, history=history)
+        self.assertEqual({'file0.cc': {'duration': 0.01},
+                          'file1.cc': {'duration': 0.02}}, history)
+
+    def test_report_callback(self):
+        invocations = [MockInvocation() for _ in range(2)]
+        for n, invocation in enumerate(invocations):
+            invocation.will_return('BAR%d' % n)
+        reported = []
+        formatter = iwyu_tool.FORMATTERS[iwyu_tool.DEFAULT_FORMAT]
+        iwyu_tool.execute(invocations, False, formatter, 2,
+                          report=lambda i, output: reported.append((i, output)))
+        self.assertEqual(set(zip(invocations, ['BAR0', 'BAR1'])), set(reported))
+        self.assertEqual('', self.stdout_stub.getvalue())
+
+    def test_read_dependencies(self):
+        with tempfile.NamedTemporaryFile('w', suffix='.deps',
+                                         delete=False) as fileobj:
+            fileobj.write('file.cc\n../include/a.h\n/usr/include/stdio.h\n')
+        try:
+            dependencies = iwyu_tool.read_dependencies(
+                fileobj.name, os.path.join(os.sep, 'src', 'build'))
+        finally:
+            os.remove(fileobj.name)
+        self.assertEqual(
+            set([os.path.join(os.sep, 'src', 'build', 'file.cc'),
+                 os.path.join(os.sep, 'src', 'include', 'a.h'),
+                 os.path.normpath('/usr/include/stdio.h')]),
+            dependencies)
+
+    def test_read_dependencies_missing(self):
+        self.assertEqual(set(), iwyu_tool.read_dependencies(
+            os.path.join(tempfile.gettempdir(), 'iwyu-no-such.deps'), ''))
+
+    def test_affected_invocations(self):
+        invocations = [MockInvocation() for _ in range(3)]
+        dependencies = {
+            invocations[0]: set(['a.cc', 'common.h']),
+            invocations[1]: set(['b.cc', 'common.h', 'b.h']),
+            invocations[2]: set(['c.cc']),
+        }
+        self.assertEqual(invocations[:2], iwyu_tool.affected_invocations(
+            invocations, dependencies, set(['common.h'])))
+        self.assertEqual([invocations[1]], iwyu_tool.affected_invocations(
+            invocations, dependencies, set(['b.h', 'unrelated.h'])))
+        self.assertEqual([], iwyu_tool.affected_invocations(
+            invocations, dependencies, set()))
+
+    def test_watch_uses_memory_budget_and_history(self):
+        """ watch passes memory_budget and history on to every run, and
+        saves the history after it. """
+        invocation = MockInvocation()
+        invocation.key = 'file.cc'
+        executed = []
+        saved = []
+
+        def fake_execute(invocations, verbose, formatter, jobs,
+                         max_load_average=0, memory_budget=0, history=None,
+                         report=None):
+            executed.append((invocations, memory_budget, history))
+            history[invocations[0].key] = {'duration': 1.5}
+            return 0
+
+        class InterruptingTime(object):
+            @staticmethod
+            def sleep(seconds):
+                raise KeyboardInterrupt()
+
+        real_execute, real_save_history, real_time = (
+            iwyu_tool.execute, iwyu_tool.save_history, iwyu_tool.time)
+        iwyu_tool.execute = fake_execute
+        iwyu_tool.save_history = lambda path, history: saved.append(
+            (path, dict(history)))
+        iwyu_tool.time = InterruptingTime
+        try:
+            history = {}
+            formatter = iwyu_tool.FORMATTERS[iwyu_tool.DEFAULT_FORMAT]
+            self.assertEqual(0, iwyu_tool.watch(
+                [invocation], False, formatter, 1, memory_budget=1024,
+                history=history, history_path='history.json'))
+        finally:
+            iwyu_tool.execute = real_execute
+            iwyu_tool.save_history = real_save_history
+            iwyu_tool.time = real_time
+
+        self.assertEqual([([invocation], 1024, history)], executed)
+        self.assertEqual(
+            [('history.json', {'file.cc': {'duration': 1.5}})], saved)
+
     @unittest.skipIf(sys.platform.startswith('win'), "POSIX only")
     def test_is_subpath_of_posix(self):
         self.assertTrue(iwyu_tool.is_subpath_of('/a/b/c.c', '/a/b'))
@@ -393,6 +545,30 @@ class BootstrapTests(unittest.TestCase):
         iwyu_tool._bootstrap(argv)
         self.assertEqual(1, self.main.call_args['jobs'])
 
+    def test_scheduling_args(self):
+        """ Scheduling arguments are forwarded to main. """
+        argv = ['iwyu_tool.py', '-p', '.', '--history', 'h.json',
+                '--memory-budget', '2', '--shard', '2/3']
+        iwyu_tool._bootstrap(argv)
+        self.assertEqual('h.json', self.main.call_args['history_path'])
+        self.assertEqual(2 * 1024 * 1024,
+                         self.main.call_args['memory_budget'])
+        self.assertEqual((2, 3), self.main.call_args['shard'])
+
+    def test_watch(self):
+        """ --watch is forwarded to main, and is off by default. """
+        iwyu_tool._bootstrap(['iwyu_tool.py', '-p', '.'])
+        self.assertEqual(False, self.main.call_args['watch_files'])
+        iwyu_tool._bootstrap(['iwyu_tool.py', '-p', '.', '--watch'])
+        self.assertEqual(True, self.main.call_args['watch_files'])
+
+    def test_shard_invalid(self):
+        """ Shard indexes are 1-based and bounded by the shard count. """
+        for shard in ['0/3', '4/3', '1', 'a/b']:
+            with self.assertRaises(SystemExit):
+                iwyu_tool._bootstrap(['iwyu_tool.py', '-p', '.',
+                                      '--shard', shard])
+
 
 class CompilationDBTests(unittest.TestCase):
     def setUp(self):
@@ -0,0 +1,24 @@
+//===--- check_only.cc - test input file for iwyu -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// IWYU_ARGS: -Xiwyu --check_only -Xiwyu --error=3 -I .
+
+// Tests that --check_only prints no diagnostics or diffs, and stops at the
+// first file with iwyu violations.  check_only.h is calculated before its
+// associated check_only.cc and has violations, so check_only.cc is never
+// calculated and gets no summary, although it has violations as well.
+
+#include "tests/cxx/check_only.h"
+#include "tests/cxx/direct.h"
+
+IndirectClass ic;
+
+/**** IWYU_SUMMARY(3)
+
+***** IWYU_SUMMARY */
@@ -0,0 +1,20 @@
+//===--- check_only.h - test input file for iwyu --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tests/cxx/direct.h"
+
+namespace hfile {
+IndirectClass ic;
+}
+
+/**** IWYU_SUMMARY
+
+(tests/cxx/check_only.h has iwyu violations)
+
+***** IWYU_SUMMARY */
@@ -0,0 +1,50 @@
+//===--- full_use_template.cc - test input file for iwyu ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// IWYU_ARGS: -Xiwyu --mapping_file=tests/cxx/full_use_template.imp -I .
+
+// Tests that the 'full_use_template' mapping directive adds templates to
+// the precomputed template-arg-use list in iwyu_cache.cc.
+
+#include "tests/cxx/direct.h"
+
+namespace ns {
+// Both only store pointers, but the mapping file says that Container
+// requires its argument to be complete, like std::set.
+template <typename T>
+class Container {
+  T* first;
+};
+
+template <typename T>
+class PointerContainer {
+  T* first;
+};
+}  // namespace ns
+
+void Fn() {
+  // IWYU: IndirectClass needs a declaration
+  // IWYU: IndirectClass is...*indirect.h
+  (void)sizeof(ns::Container<IndirectClass>);
+  // IWYU: IndirectClass needs a declaration
+  (void)sizeof(ns::PointerContainer<IndirectClass>);
+}
+
+/**** IWYU_SUMMARY
+
+tests/cxx/full_use_template.cc should add these lines:
+#include "tests/cxx/indirect.h"
+
+tests/cxx/full_use_template.cc should remove these lines:
+- #include "tests/cxx/direct.h"  // lines XX-XX
+
+The full include-list for tests/cxx/full_use_template.cc:
+#include "tests/cxx/indirect.h"  // for IndirectClass
+
+***** IWYU_SUMMARY */
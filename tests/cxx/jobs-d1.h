@@ -0,0 +1,35 @@
+//===--- jobs-d1.h - test input file for iwyu -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_D1_H_
+#define INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_D1_H_
+
+#include "tests/cxx/direct.h"
+
+class ClassFromD1 {};
+
+namespace d1 {
+// IWYU: IndirectClass is...*indirect.h
+IndirectClass ic;
+}
+
+#endif  // INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_D1_H_
+
+/**** IWYU_SUMMARY
+
+tests/cxx/jobs-d1.h should add these lines:
+#include "tests/cxx/indirect.h"
+
+tests/cxx/jobs-d1.h should remove these lines:
+- #include "tests/cxx/direct.h"  // lines XX-XX
+
+The full include-list for tests/cxx/jobs-d1.h:
+#include "tests/cxx/indirect.h"  // for IndirectClass
+
+***** IWYU_SUMMARY */
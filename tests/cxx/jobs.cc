@@ -0,0 +1,37 @@
+//===--- jobs.cc - test input file for iwyu -------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// IWYU_ARGS: -Xiwyu --jobs=4 -Xiwyu --check_also="tests/cxx/jobs-d1.h" -I .
+
+// Tests that calculating iwyu violations on several threads gives the
+// same results as on a single thread.  jobs.cc has to be calculated after
+// its associated header jobs.h, while jobs-d1.h is independent of both.
+
+#include "tests/cxx/jobs.h"
+#include "tests/cxx/direct.h"
+#include "tests/cxx/jobs-d1.h"
+
+// jobs.h will directly include indirect.h, so there is no need to add it
+// here.
+// IWYU: IndirectClass is...*indirect.h
+IndirectClass ic;
+ClassFromD1 d1;
+
+/**** IWYU_SUMMARY
+
+tests/cxx/jobs.cc should add these lines:
+
+tests/cxx/jobs.cc should remove these lines:
+- #include "tests/cxx/direct.h"  // lines XX-XX
+
+The full include-list for tests/cxx/jobs.cc:
+#include "tests/cxx/jobs.h"
+#include "tests/cxx/jobs-d1.h"  // for ClassFromD1
+
+***** IWYU_SUMMARY */
@@ -0,0 +1,28 @@
+//===--- jobs.h - test input file for iwyu --------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tests/cxx/direct.h"
+
+namespace hfile {
+// IWYU: IndirectClass is...*indirect.h
+IndirectClass ic;
+}
+
+/**** IWYU_SUMMARY
+
+tests/cxx/jobs.h should add these lines:
+#include "tests/cxx/indirect.h"
+
+tests/cxx/jobs.h should remove these lines:
+- #include "tests/cxx/direct.h"  // lines XX-XX
+
+The full include-list for tests/cxx/jobs.h:
+#include "tests/cxx/indirect.h"  // for IndirectClass
+
+***** IWYU_SUMMARY */
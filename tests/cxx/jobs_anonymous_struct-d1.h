@@ -0,0 +1,25 @@
+//===--- jobs_anonymous_struct-d1.h - test input file for iwyu ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_ANONYMOUS_STRUCT_D1_H_
+#define INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_ANONYMOUS_STRUCT_D1_H_
+
+#include "tests/cxx/jobs_anonymous_struct-i1.h"
+
+inline decltype(anonymous_holder)::Inner MakeInner() {
+  return {};
+}
+
+#endif  // INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_ANONYMOUS_STRUCT_D1_H_
+
+/**** IWYU_SUMMARY
+
+(tests/cxx/jobs_anonymous_struct-d1.h has correct #includes/fwd-decls)
+
+***** IWYU_SUMMARY */
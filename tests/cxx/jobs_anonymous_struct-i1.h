@@ -0,0 +1,18 @@
+//===--- jobs_anonymous_struct-i1.h - test input file for iwyu ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_ANONYMOUS_STRUCT_I1_H_
+#define INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_ANONYMOUS_STRUCT_I1_H_
+
+// Clang names Inner "(anonymous struct at <location>)::Inner".
+struct {
+  struct Inner {};
+} anonymous_holder;
+
+#endif  // INCLUDE_WHAT_YOU_USE_TESTS_CXX_JOBS_ANONYMOUS_STRUCT_I1_H_
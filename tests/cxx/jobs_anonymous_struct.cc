@@ -0,0 +1,35 @@
+//===--- jobs_anonymous_struct.cc - test input file for iwyu --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// IWYU_ARGS: -Xiwyu --jobs=2 -Xiwyu --no_comments \
+//            -Xiwyu --check_also="tests/cxx/jobs_anonymous_struct-d1.h" -I .
+
+// Tests that the names of members of unnamed structs, which Clang prints
+// with the location of the struct, can be looked up while the reported
+// files are calculated on several threads.  Both this file and
+// jobs_anonymous_struct-d1.h use such a member.
+
+#include "tests/cxx/jobs_anonymous_struct-d1.h"
+
+// IWYU: anonymous_holder is...*jobs_anonymous_struct-i1.h
+// IWYU: ...*::Inner is...*jobs_anonymous_struct-i1.h
+decltype(anonymous_holder)::Inner inner;
+
+/**** IWYU_SUMMARY
+
+tests/cxx/jobs_anonymous_struct.cc should add these lines:
+#include "tests/cxx/jobs_anonymous_struct-i1.h"
+
+tests/cxx/jobs_anonymous_struct.cc should remove these lines:
+- #include "tests/cxx/jobs_anonymous_struct-d1.h"
+
+The full include-list for tests/cxx/jobs_anonymous_struct.cc:
+#include "tests/cxx/jobs_anonymous_struct-i1.h"
+
+***** IWYU_SUMMARY */
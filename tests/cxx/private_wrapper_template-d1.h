@@ -0,0 +1,22 @@
+//===--- private_wrapper_template-d1.h - test input file for iwyu ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INCLUDE_WHAT_YOU_USE_TESTS_CXX_PRIVATE_WRAPPER_TEMPLATE_D1_H_
+#define INCLUDE_WHAT_YOU_USE_TESTS_CXX_PRIVATE_WRAPPER_TEMPLATE_D1_H_
+
+#include "tests/cxx/private_wrapper_template-i1.h"
+
+class IntContainer {
+ public:
+  typedef ns::IteratorWrapper<int, IntContainer> iterator;
+  iterator begin();
+  iterator end();
+};
+
+#endif  // INCLUDE_WHAT_YOU_USE_TESTS_CXX_PRIVATE_WRAPPER_TEMPLATE_D1_H_
@@ -0,0 +1,28 @@
+//===--- private_wrapper_template-i1.h - test input file for iwyu ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef INCLUDE_WHAT_YOU_USE_TESTS_CXX_PRIVATE_WRAPPER_TEMPLATE_I1_H_
+#define INCLUDE_WHAT_YOU_USE_TESTS_CXX_PRIVATE_WRAPPER_TEMPLATE_I1_H_
+
+namespace ns {
+// A private iterator type, which containers expose through typedefs, like
+// __gnu_cxx::__normal_iterator.  Container is the wrapped type argument.
+template <typename T, typename Container>
+class IteratorWrapper {
+ public:
+  T& operator*() const;
+  IteratorWrapper& operator++();
+  bool operator!=(const IteratorWrapper& other) const;
+
+ private:
+  T* ptr;
+};
+}  // namespace ns
+
+#endif  // INCLUDE_WHAT_YOU_USE_TESTS_CXX_PRIVATE_WRAPPER_TEMPLATE_I1_H_
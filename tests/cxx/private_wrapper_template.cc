@@ -0,0 +1,39 @@
+//===--- private_wrapper_template.cc - test input file for iwyu -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// IWYU_ARGS: -Xiwyu --mapping_file=tests/cxx/private_wrapper_template.imp \
+//            -I .
+
+// Tests that the 'private_wrapper_template' mapping directive maps uses of
+// a private wrapper template to its wrapped type argument, like IWYU does
+// for __gnu_cxx::__normal_iterator (see iterator.cc).  IntContainer
+// provides its iterator typedef, so none of the code below should result
+// in an #include of private_wrapper_template-i1.h.
+
+#include "tests/cxx/private_wrapper_template-d1.h"
+
+IntContainer c;
+
+template <typename It>
+int Deref(It it) {
+  return *it;
+}
+
+void Fn() {
+  // The typedef is lost in the deduced template argument.
+  Deref(c.begin());
+  for (IntContainer::iterator it = c.begin(); it != c.end(); ++it)
+    ;
+}
+
+/**** IWYU_SUMMARY
+
+(tests/cxx/private_wrapper_template.cc has correct #includes/fwd-decls)
+
+***** IWYU_SUMMARY */
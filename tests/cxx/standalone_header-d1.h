@@ -0,0 +1,26 @@
+//===--- standalone_header-d1.h - test input file for iwyu ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tests/cxx/direct.h"
+
+// IWYU: IndirectClass is...*indirect.h
+IndirectClass standalone_header_d1;
+
+/**** IWYU_SUMMARY
+
+tests/cxx/standalone_header-d1.h should add these lines:
+#include "tests/cxx/indirect.h"
+
+tests/cxx/standalone_header-d1.h should remove these lines:
+- #include "tests/cxx/direct.h"  // lines XX-XX
+
+The full include-list for tests/cxx/standalone_header-d1.h:
+#include "tests/cxx/indirect.h"  // for IndirectClass
+
+***** IWYU_SUMMARY */
@@ -0,0 +1,21 @@
+//===--- standalone_header.cc - test input file for iwyu ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// IWYU_ARGS: -I . -Xiwyu --standalone_header=tests/cxx/standalone_header-d1.h
+
+// Tests that --standalone_header analyzes the header in a translation unit
+// that includes only the header, with the compile flags of this file.  This
+// file isn't compiled, so its (unused) #include and use of IndirectClass
+// aren't reported, and neither is standalone_header.h, which it would
+// otherwise have as associated header.
+
+#include "tests/cxx/standalone_header.h"
+#include "tests/cxx/direct.h"
+
+IndirectClass ic;
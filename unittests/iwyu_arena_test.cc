@@ -0,0 +1,62 @@
+//===--- iwyu_arena_test.cc - test iwyu_arena.h ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// Tests for the iwyu_arena module.
+
+#include "iwyu_arena.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "llvm/ADT/ArrayRef.h"
+
+namespace include_what_you_use {
+using std::string;
+using std::vector;
+
+namespace {
+
+TEST(ArenaTest, CopiesIntoArena) {
+  Arena arena;
+  const vector<int> values{3, 1, 2};
+  llvm::ArrayRef<int> copy = arena.Copy<int>(values);
+  EXPECT_EQ(values, copy.vec());
+  EXPECT_NE(values.data(), copy.data());
+  EXPECT_GE(arena.BytesAllocated(), sizeof(int) * values.size());
+
+  EXPECT_TRUE(arena.Copy<int>(llvm::ArrayRef<int>()).empty());
+}
+
+TEST(ArenaTest, VectorAllocatesFromArena) {
+  Arena arena;
+  ArenaVector<string> strings{ArenaAllocator<string>(&arena)};
+  EXPECT_EQ(0U, arena.BytesAllocated());
+  for (int i = 0; i < 100; ++i)
+    strings.push_back(std::to_string(i));
+  EXPECT_EQ("99", strings.back());
+  EXPECT_GE(arena.BytesAllocated(), sizeof(string) * strings.size());
+
+  // Copies and moves keep allocating from the same arena.
+  ArenaVector<string> copy = strings;
+  EXPECT_TRUE(copy.get_allocator() == strings.get_allocator());
+  ArenaVector<string> moved = std::move(copy);
+  EXPECT_EQ(strings, moved);
+}
+
+TEST(ArenaTest, AllocatorsOfDifferentArenasDiffer) {
+  Arena arena1;
+  Arena arena2;
+  EXPECT_TRUE(ArenaAllocator<int>(&arena1) == ArenaAllocator<char>(&arena1));
+  EXPECT_TRUE(ArenaAllocator<int>(&arena1) != ArenaAllocator<int>(&arena2));
+}
+
+}  // namespace
+}  // namespace include_what_you_use
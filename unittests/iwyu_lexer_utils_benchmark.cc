@@ -0,0 +1,187 @@
+//===--- iwyu_lexer_utils_benchmark.cc - time iwyu_lexer_utils scans ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// Times the line scanning behind IWYU pragma detection (see LineHasPragma)
+// on real headers, to tell whether it is worth vectorizing.  It is not a
+// test; run it by hand on some large headers, e.g.
+//   iwyu-lexer-utils-benchmark /usr/include/c++/*/bits/*.h
+//
+// Every line of the files is scanned the way LineHasPragma scans the line
+// of an #include or forward-declaration: GetSourceTextUntilEndOfLine finds
+// its end, and HasPragmaComment looks for a keep and an export pragma.
+// Where SSE2 is available, the same is timed with the end of the line
+// found 16 bytes at a time, for comparison.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "clang/Basic/SourceLocation.h"
+#include "iwyu_lexer_utils.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace include_what_you_use {
+
+using clang::SourceLocation;
+using llvm::StringRef;
+using std::string;
+using std::vector;
+
+namespace {
+
+const int kRepetitions = 20;
+
+// Gets character data from one string, with offsets into it as the raw
+// encodings of the source locations.
+class StringCharacterDataGetter : public CharacterDataGetterInterface {
+ public:
+  explicit StringCharacterDataGetter(const string& str) : str_(str) {
+  }
+
+  const char* GetCharacterData(SourceLocation loc) const override {
+    return str_.c_str() + loc.getRawEncoding();
+  }
+
+ private:
+  const string& str_;
+};
+
+#if defined(__SSE2__)
+// Like GetSourceTextUntilEndOfLine, but finds the end of the line 16 bytes
+// at a time.  Blocks are loaded aligned, so no load crosses into a page
+// after the terminating NUL.
+StringRef SSE2SourceTextUntilEndOfLine(const char* data) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  const uintptr_t misalignment = reinterpret_cast<uintptr_t>(data) & 15;
+  const char* block = data - misalignment;
+  unsigned mask = ~0U << misalignment;
+  while (true) {
+    const __m128i bytes =
+        _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+    const __m128i line_end =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, cr),
+                                  _mm_cmpeq_epi8(bytes, lf)),
+                     _mm_cmpeq_epi8(bytes, nul));
+    const unsigned found = _mm_movemask_epi8(line_end) & mask;
+    if (found != 0) {
+      const char* end = block + __builtin_ctz(found);
+      return StringRef(data, end - data);
+    }
+    block += 16;
+    mask = ~0U;
+  }
+}
+#endif
+
+// Times scan_line on every line, and prints the best of kRepetitions runs.
+// scan_line returns whether the line counts, to keep it from being
+// optimized away.
+template <typename LineScanner>
+void TimeScan(const char* name, const string& text,
+              const vector<unsigned>& line_offsets,
+              const LineScanner& scan_line) {
+  size_t num_counted = 0;
+  std::chrono::nanoseconds best = std::chrono::nanoseconds::max();
+  for (int i = 0; i < kRepetitions; ++i) {
+    num_counted = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned offset : line_offsets)
+      num_counted += scan_line(offset);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(
+        best, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
+  }
+  const double ns = best.count();
+  llvm::outs() << llvm::format("%-40s %7.2f ns/line %8.1f MB/s", name,
+                               ns / line_offsets.size(),
+                               text.size() * 1e3 / ns)
+               << "  (" << num_counted << ")\n";
+}
+
+bool HasKeepOrExportPragma(StringRef line) {
+  return HasPragmaComment(line, "keep") || HasPragmaComment(line, "export");
+}
+
+}  // anonymous namespace
+
+int RunBenchmark(int argc, char** argv) {
+  // Offset 0 would be the invalid source location, so start at 1.
+  string text = "\n";
+  for (int i = 1; i < argc; ++i) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFile(argv[i]);
+    if (!buffer) {
+      llvm::errs() << argv[i] << ": " << buffer.getError().message() << "\n";
+      continue;
+    }
+    text += (*buffer)->getBuffer();
+    if (!text.empty() && text.back() != '\n')
+      text += '\n';
+  }
+  vector<unsigned> line_offsets;
+  for (size_t offset = 1; offset < text.size(); ++offset) {
+    if (text[offset - 1] == '\n')
+      line_offsets.push_back(offset);
+  }
+  if (line_offsets.empty()) {
+    llvm::errs() << "usage: " << argv[0] << " <file>...\n";
+    return 1;
+  }
+  llvm::outs() << line_offsets.size() << " lines, " << text.size()
+               << " bytes, best of " << kRepetitions << " runs\n";
+
+  const StringCharacterDataGetter data_getter(text);
+  auto text_until_end_of_line = [&data_getter](unsigned offset) {
+    return GetSourceTextUntilEndOfLine(
+        SourceLocation::getFromRawEncoding(offset), data_getter);
+  };
+  TimeScan("end of line", text, line_offsets,
+           [&](unsigned offset) {
+             return !text_until_end_of_line(offset).empty();
+           });
+  TimeScan("end of line + keep/export pragmas", text, line_offsets,
+           [&](unsigned offset) {
+             return HasKeepOrExportPragma(text_until_end_of_line(offset));
+           });
+#if defined(__SSE2__)
+  auto sse2_text_until_end_of_line = [&data_getter](unsigned offset) {
+    return SSE2SourceTextUntilEndOfLine(data_getter.GetCharacterData(
+        SourceLocation::getFromRawEncoding(offset)));
+  };
+  TimeScan("SSE2 end of line", text, line_offsets,
+           [&](unsigned offset) {
+             return !sse2_text_until_end_of_line(offset).empty();
+           });
+  TimeScan("SSE2 end of line + keep/export pragmas", text, line_offsets,
+           [&](unsigned offset) {
+             return HasKeepOrExportPragma(sse2_text_until_end_of_line(offset));
+           });
+#endif
+  return 0;
+}
+
+}  // namespace include_what_you_use
+
+int main(int argc, char** argv) {
+  return include_what_you_use::RunBenchmark(argc, argv);
+}
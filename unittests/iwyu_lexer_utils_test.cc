@@ -165,6 +165,75 @@ TEST(GetLocationAfter, BeginAfterStartOfText) {
             GetSourceTextUntilEndOfLine(after_loc, data_getter));
 }
 
+TEST(GetLeadingCommentText, Comments) {
+  const char text[] =
+      "// License.\n\n/** @file\n * @headername{foo}\n */\n#ifndef FOO\n";
+  StringCharacterDataGetter data_getter(text);
+  SourceLocation begin_loc = data_getter.BeginningOfString();
+  EXPECT_EQ("// License.\n\n/** @file\n * @headername{foo}\n */\n",
+            GetLeadingCommentText(begin_loc, data_getter));
+}
+
+TEST(GetLeadingCommentText, NoComments) {
+  const char text[] = "#ifndef FOO  // @file\n";
+  StringCharacterDataGetter data_getter(text);
+  SourceLocation begin_loc = data_getter.BeginningOfString();
+  EXPECT_EQ("", GetLeadingCommentText(begin_loc, data_getter));
+}
+
+TEST(GetLeadingCommentText, OnlyComments) {
+  const char text[] = "/* Block. */ // Line without newline.";
+  StringCharacterDataGetter data_getter(text);
+  SourceLocation begin_loc = data_getter.BeginningOfString();
+  EXPECT_EQ("/* Block. */ // Line without newline.",
+            GetLeadingCommentText(begin_loc, data_getter));
+}
+
+TEST(GetLeadingCommentText, UnterminatedBlockComment) {
+  const char text[] = "/* Block\nint x;\n";
+  StringCharacterDataGetter data_getter(text);
+  SourceLocation begin_loc = data_getter.BeginningOfString();
+  EXPECT_EQ("/* Block\nint x;\n",
+            GetLeadingCommentText(begin_loc, data_getter));
+}
+
+TEST(GetLeadingCommentText, Division) {
+  const char text[] = "\n/ 2";
+  StringCharacterDataGetter data_getter(text);
+  SourceLocation begin_loc = data_getter.BeginningOfString();
+  EXPECT_EQ("\n", GetLeadingCommentText(begin_loc, data_getter));
+}
+
+TEST(HasPragmaComment, LineComment) {
+  EXPECT_TRUE(HasPragmaComment("#include <a.h>  // IWYU pragma: keep", "keep"));
+  EXPECT_FALSE(
+      HasPragmaComment("#include <a.h>  // IWYU pragma: keep", "export"));
+}
+
+TEST(HasPragmaComment, BlockComment) {
+  EXPECT_TRUE(
+      HasPragmaComment("class A;  /* IWYU pragma: export */", "export"));
+  EXPECT_FALSE(HasPragmaComment("class A;  /* IWYU pragma: export */", "keep"));
+}
+
+TEST(HasPragmaComment, NoComment) {
+  EXPECT_FALSE(HasPragmaComment("", "keep"));
+  EXPECT_FALSE(HasPragmaComment("#include <a.h>", "keep"));
+  EXPECT_FALSE(HasPragmaComment("IWYU pragma: keep", "keep"));
+  EXPECT_FALSE(HasPragmaComment("const char* s = \"IWYU pragma: keep\";",
+                                "keep"));
+}
+
+TEST(HasPragmaComment, LaterOccurrence) {
+  // The first "IWYU pragma: " isn't in a comment, the second one is.
+  EXPECT_TRUE(HasPragmaComment(
+      "f(\"IWYU pragma: keep\");  // IWYU pragma: keep", "keep"));
+  EXPECT_TRUE(HasPragmaComment(
+      "#include <a.h>  // IWYU pragma: export, IWYU pragma: keep", "export"));
+  EXPECT_FALSE(HasPragmaComment(
+      "#include <a.h>  // IWYU pragma: export, IWYU pragma: keep", "keep"));
+}
+
 TEST(GetIncludeNameAsWritten, SystemInclude) {
   const char text[] = "#include <stdio.h>\n";
   StringCharacterDataGetter data_getter(text);
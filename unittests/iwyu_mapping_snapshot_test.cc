@@ -0,0 +1,123 @@
+//===--- iwyu_mapping_snapshot_test.cc - test include-picker snapshots ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// Tests for the mapping snapshots shared by include-pickers.
+
+#include <memory>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "iwyu_include_picker.h"
+#include "iwyu_regex.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace include_what_you_use {
+
+using std::set;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace {
+
+void WriteSymbolMapping(const string& path, const string& quoted_include) {
+  std::error_code error;
+  llvm::raw_fd_ostream out(path, error);
+  ASSERT_FALSE(error) << error.message();
+  out << "[\n  { \"symbol\": [\"Foo\", \"private\", \"" << quoted_include
+      << "\", \"public\"] }\n]\n";
+}
+
+shared_ptr<const IncludePicker::MappingSnapshot> GetSnapshot(
+    const string& mapping_file) {
+  return IncludePicker::GetMappingSnapshot(RegexDialect::LLVM, CStdLib::None,
+                                           CXXStdLib::None, {mapping_file});
+}
+
+string MappedHeaderForFoo(
+    shared_ptr<const IncludePicker::MappingSnapshot> snapshot) {
+  IncludePicker picker(snapshot);
+  picker.FinalizeAddedIncludes();
+  vector<MappedInclude> headers = picker.GetCandidateHeadersForSymbol("Foo");
+  return headers.size() == 1 ? headers[0].quoted_include : "";
+}
+
+TEST(GetMappingSnapshot, SharedWhileMappingFilesAreUnchanged) {
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("iwyu", "imp", path));
+  llvm::FileRemover remover(path);
+  WriteSymbolMapping(path.str().str(), "<foo.h>");
+
+  shared_ptr<const IncludePicker::MappingSnapshot> snapshot =
+      GetSnapshot(path.str().str());
+  EXPECT_EQ(snapshot, GetSnapshot(path.str().str()));
+  EXPECT_EQ("<foo.h>", MappedHeaderForFoo(snapshot));
+}
+
+// As in a process running IWYU on one translation unit after the other.
+TEST(GetMappingSnapshot, RebuiltWhenMappingFileIsEdited) {
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("iwyu", "imp", path));
+  llvm::FileRemover remover(path);
+  WriteSymbolMapping(path.str().str(), "<foo.h>");
+
+  shared_ptr<const IncludePicker::MappingSnapshot> snapshot =
+      GetSnapshot(path.str().str());
+  EXPECT_EQ("<foo.h>", MappedHeaderForFoo(snapshot));
+
+  WriteSymbolMapping(path.str().str(), "<bar.h>");
+  shared_ptr<const IncludePicker::MappingSnapshot> edited =
+      GetSnapshot(path.str().str());
+  EXPECT_NE(snapshot, edited);
+  EXPECT_EQ("<bar.h>", MappedHeaderForFoo(edited));
+  // Include-pickers still using the old snapshot are unaffected.
+  EXPECT_EQ("<foo.h>", MappedHeaderForFoo(snapshot));
+}
+
+TEST(GetMappingSnapshot, RebuiltWhenMappingFileIsCreated) {
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("iwyu", "imp", path));
+  llvm::FileRemover remover(path);
+  llvm::sys::fs::remove(path);
+
+  shared_ptr<const IncludePicker::MappingSnapshot> snapshot =
+      GetSnapshot(path.str().str());
+  EXPECT_EQ("", MappedHeaderForFoo(snapshot));
+
+  WriteSymbolMapping(path.str().str(), "<foo.h>");
+  EXPECT_EQ("<foo.h>", MappedHeaderForFoo(GetSnapshot(path.str().str())));
+}
+
+// These are listed in --dependency_file.
+TEST(GetMappingFiles, ListsReadAndUnreadableMappingFiles) {
+  llvm::SmallString<128> path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("iwyu", "imp", path));
+  llvm::FileRemover remover(path);
+  WriteSymbolMapping(path.str().str(), "<foo.h>");
+  llvm::SmallString<128> missing_path;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("iwyu", "imp", missing_path));
+  llvm::sys::fs::remove(missing_path);
+
+  IncludePicker picker(IncludePicker::GetMappingSnapshot(
+      RegexDialect::LLVM, CStdLib::None, CXXStdLib::None,
+      {path.str().str(), missing_path.str().str()}));
+  EXPECT_EQ(set<string>({path.str().str(), missing_path.str().str()}),
+            picker.GetMappingFiles());
+}
+
+}  // namespace
+
+}  // namespace include_what_you_use
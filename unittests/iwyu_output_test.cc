@@ -36,7 +36,7 @@ string MungedForwardDeclareLine(const NamedDecl* decl);
 set<string> CalculateMinimalIncludes(
     const set<string>& direct_includes,
     const set<string>& associated_direct_includes,
-    vector<OneUse>* uses);
+    ArenaVector<OneUse>* uses);
 
 void ProcessForwardDeclare(OneUse* use);
 
@@ -53,9 +53,9 @@ void CalculateIwyuForFullUse(OneUse* use,
                              const set<string>& desired_includes);
 
 void CalculateDesiredIncludesAndForwardDeclares(
-    const vector<OneUse>& uses,
+    const ArenaVector<OneUse>& uses,
     const set<string> associated_desired_includes,
-    vector<OneIncludeOrForwardDeclareLine>* lines);
+    ArenaVector<OneIncludeOrForwardDeclareLine>* lines);
 
 string PrintableIncludeOrForwardDeclareLine(
     const OneIncludeOrForwardDeclareLine& line,
@@ -63,7 +63,7 @@ string PrintableIncludeOrForwardDeclareLine(
 
 string PrintableDiffs(const string& filename,
                       const set<string>& associated_quoted_includes,
-                      const vector<OneIncludeOrForwardDeclareLine>& lines);
+                      const ArenaVector<OneIncludeOrForwardDeclareLine>& lines);
 
 struct FakeSourceLocation : public SourceLocation {
   FakeSourceLocation(const string& fp, int ln)
@@ -307,7 +307,7 @@ TEST_F(PrintableIncludeOrForwardDeclareLineTest, SortsSymbolsByFreqThenAlpha) {
 }
 
 TEST(PrintableDiffsTest, PrintsEmptyIncludes) {
-  vector<OneIncludeOrForwardDeclareLine> no_lines;
+  ArenaVector<OneIncludeOrForwardDeclareLine> no_lines;
   EXPECT_EQ("\n"
             "(baz.cc has correct #includes/fwd-decls)\n",
             internal::PrintableDiffs("baz.cc", set<string>(), no_lines));
@@ -317,7 +317,7 @@ TEST(PrintableDiffsTest, ProperlyOrdersIncludeLines) {
   set<string> associated_includes;
   associated_includes.insert("\"baz.h\"");
   associated_includes.insert("\"baz-inl.h\"");
-  vector<OneIncludeOrForwardDeclareLine> lines;
+  ArenaVector<OneIncludeOrForwardDeclareLine> lines;
   lines.push_back(MakeDesiredIncludeLine("\"foo.h\"", "FOO"));
   lines.push_back(MakeDesiredIncludeLine("\"bar.h\"", "BAR"));
   lines.push_back(MakeDesiredIncludeLine("\"baz.h\"", "BAZ"));
@@ -360,7 +360,7 @@ TEST(PrintableDiffsTest, ProperlyOrdersIncludeLines) {
 
 TEST(PrintableDiffsTest, ShowLineNumbersForDeletedIncludesEvenWithUses) {
   const set<string> empty;
-  vector<OneIncludeOrForwardDeclareLine> lines;
+  ArenaVector<OneIncludeOrForwardDeclareLine> lines;
   OneIncludeOrForwardDeclareLine line("\"foo.h\"", 1);
   line.set_present();   // *not* desired
   line.AddSymbolUse("Foo (ptr only)");
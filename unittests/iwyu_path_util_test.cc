@@ -71,5 +71,53 @@ TEST(IsQuotedHeaderFilename, Basic) {
   EXPECT_FALSE(IsQuotedHeaderFilename("<source.cpp>"));
 }
 
+TEST(GlobSet, Empty) {
+  GlobSet globs;
+  EXPECT_TRUE(globs.empty());
+  EXPECT_FALSE(globs.Matches("foo.h"));
+  EXPECT_FALSE(globs.Matches(""));
+}
+
+TEST(GlobSet, Literals) {
+  GlobSet globs;
+  globs.Insert("dir/foo.h");
+  globs.Insert("foo.cc");
+  EXPECT_FALSE(globs.empty());
+
+  EXPECT_TRUE(globs.Matches("dir/foo.h"));
+  EXPECT_TRUE(globs.Matches("foo.cc"));
+  EXPECT_FALSE(globs.Matches("foo.h"));
+  EXPECT_FALSE(globs.Matches("dir/foo.cc"));
+  EXPECT_FALSE(globs.Matches("dir/foo.hpp"));
+}
+
+TEST(GlobSet, Wildcards) {
+  GlobSet globs;
+  globs.Insert("dir/*.h");
+  globs.Insert("*.moc");
+  globs.Insert("other/foo?.h");
+
+  EXPECT_TRUE(globs.Matches("dir/foo.h"));
+  EXPECT_TRUE(globs.Matches("dir/sub/foo.h"));
+  EXPECT_TRUE(globs.Matches("foo.moc"));
+  EXPECT_TRUE(globs.Matches("dir/foo.moc"));
+  EXPECT_TRUE(globs.Matches("other/foo1.h"));
+  EXPECT_FALSE(globs.Matches("other/foo.h"));
+  EXPECT_FALSE(globs.Matches("dirx/foo.h"));
+  EXPECT_FALSE(globs.Matches("foo.h"));
+  EXPECT_FALSE(globs.Matches("di"));
+}
+
+TEST(GlobSet, Mixed) {
+  GlobSet globs;
+  globs.Insert("dir/foo.h");
+  globs.Insert("dir/*.cc");
+  globs.Insert("dir/*.cc");
+
+  EXPECT_TRUE(globs.Matches("dir/foo.h"));
+  EXPECT_TRUE(globs.Matches("dir/foo.cc"));
+  EXPECT_FALSE(globs.Matches("dir/bar.h"));
+}
+
 }  // namespace
 }  // namespace include_what_you_use
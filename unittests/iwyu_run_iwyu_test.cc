@@ -0,0 +1,148 @@
+//===--- iwyu_run_iwyu_test.cc - test running iwyu in-process -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+// Tests for analyzing translation units one after the other with RunIwyu.
+
+#include <string>
+#include <system_error>
+
+#include "gtest/gtest.h"
+#include "iwyu.h"
+#include "iwyu_arena.h"
+#include "iwyu_ast_util.h"
+#include "iwyu_globals.h"
+#include "iwyu_string_util.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace include_what_you_use {
+
+using std::string;
+
+namespace {
+
+class RunIwyuTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    // As in iwyu_main.cc.
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+  }
+
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("iwyu", dir_));
+    saved_flags_ = GlobalFlags();
+    // a.cc uses Foo and Holder from a.h, but only includes b.h.
+    WriteFile("a.h",
+              "struct Foo { int Get() const { return 1; } };\n"
+              "template <typename T> struct Holder {\n"
+              "  int Get() const { return t.Get(); }\n"
+              "  T t;\n"
+              "};\n");
+    WriteFile("b.h", "#include \"a.h\"\n");
+    WriteFile("a.cc",
+              "#include \"b.h\"\n"
+              "int Use() {\n"
+              "  Holder<Foo> holder;\n"
+              "  return holder.Get();\n"
+              "}\n");
+    // c.cc includes exactly what it uses.
+    WriteFile("c.h", "struct Bar {};\n");
+    WriteFile("c.cc",
+              "#include \"c.h\"\n"
+              "Bar bar;\n");
+  }
+
+  void TearDown() override {
+    // RunIwyu replaces the global flags; other tests expect the defaults.
+    SetGlobalFlags(saved_flags_);
+    llvm::sys::fs::remove_directories(dir_);
+  }
+
+  void WriteFile(const string& name, const string& contents) {
+    std::error_code error;
+    llvm::raw_fd_ostream out(PathOf(name), error);
+    ASSERT_FALSE(error) << error.message();
+    out << contents;
+  }
+
+  string PathOf(const string& name) const {
+    llvm::SmallString<128> path(dir_);
+    llvm::sys::path::append(path, name);
+    return path.str().str();
+  }
+
+  IwyuResult Run(const string& name, const CommandlineFlags& flags) {
+    const string path = PathOf(name);
+    const char* argv[] = {"include-what-you-use", path.c_str()};
+    return RunIwyu(2, argv, flags);
+  }
+
+  llvm::SmallString<128> dir_;
+  CommandlineFlags saved_flags_;
+};
+
+void ExpectSameResult(const IwyuResult& expected, const IwyuResult& actual) {
+  EXPECT_EQ(expected.success, actual.success);
+  EXPECT_EQ(expected.exit_code, actual.exit_code);
+  EXPECT_EQ(expected.num_edits, actual.num_edits);
+  ASSERT_EQ(expected.files.size(), actual.files.size());
+  for (size_t i = 0; i < expected.files.size(); ++i) {
+    EXPECT_EQ(expected.files[i].path, actual.files[i].path);
+    EXPECT_EQ(expected.files[i].num_edits, actual.files[i].num_edits);
+    EXPECT_EQ(expected.files[i].output, actual.files[i].output);
+  }
+}
+
+TEST_F(RunIwyuTest, AnalyzesTranslationUnitsBackToBack) {
+  const CommandlineFlags flags;
+  const IwyuResult a_result = Run("a.cc", flags);
+  ASSERT_TRUE(a_result.success);
+  EXPECT_GT(a_result.num_edits, 0U);
+  ASSERT_FALSE(a_result.files.empty());
+  EXPECT_TRUE(EndsWith(a_result.files.back().path, "a.cc"));
+  EXPECT_EQ(a_result.num_edits, a_result.files.back().num_edits);
+  const FlattenerCacheStatistics a_flattener =
+      GetFlattenerCacheStatisticsForTesting();
+  const size_t a_written_names = NumWrittenQualifiedNamesForTesting();
+  const size_t a_arena_bytes = GlobalArena()->BytesAllocated();
+  EXPECT_GT(a_flattener.num_misses, 0U);
+  EXPECT_GT(a_written_names, 0U);
+  EXPECT_GT(a_arena_bytes, 0U);
+
+  CommandlineFlags c_flags;
+  c_flags.max_line_length = 100;
+  const IwyuResult c_result = Run("c.cc", c_flags);
+  ASSERT_TRUE(c_result.success);
+  EXPECT_EQ(0U, c_result.num_edits);
+  ASSERT_FALSE(c_result.files.empty());
+  EXPECT_TRUE(EndsWith(c_result.files.back().path, "c.cc"));
+  EXPECT_EQ(100, GlobalFlags().max_line_length);
+
+  // Analyzing a.cc again starts from scratch: nothing is left over from
+  // the earlier translation units, neither in its result, nor in the
+  // per-translation-unit caches, nor in the global flags.
+  ExpectSameResult(a_result, Run("a.cc", flags));
+  const FlattenerCacheStatistics a_flattener_again =
+      GetFlattenerCacheStatisticsForTesting();
+  EXPECT_EQ(a_flattener.num_cached_decls, a_flattener_again.num_cached_decls);
+  EXPECT_EQ(a_flattener.num_hits, a_flattener_again.num_hits);
+  EXPECT_EQ(a_flattener.num_misses, a_flattener_again.num_misses);
+  EXPECT_EQ(a_written_names, NumWrittenQualifiedNamesForTesting());
+  EXPECT_EQ(a_arena_bytes, GlobalArena()->BytesAllocated());
+  EXPECT_EQ(flags.max_line_length, GlobalFlags().max_line_length);
+}
+
+}  // namespace
+
+}  // namespace include_what_you_use
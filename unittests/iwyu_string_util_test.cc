@@ -15,6 +15,7 @@
 
 #include "gtest/gtest.h"
 #include "iwyu_test_helpers.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace include_what_you_use {
 using std::string;
@@ -192,5 +193,49 @@ TEST(IwyuStringUtilTest, FormatISO8601) {
   EXPECT_EQ("2026-01-24T21:04:04Z", FormatISO8601(1769288644));
 }
 
+TEST(IwyuStringUtilTest, InternedString) {
+  StringInterner interner;
+  const string path = "/usr/include/stdio.h";
+  InternedString a = interner.Intern(path);
+  InternedString b = interner.Intern(StringRef("/usr/include/stdio.h"));
+  InternedString c = interner.Intern("/usr/include/stdlib.h");
+  EXPECT_EQ(path, a.str());
+  EXPECT_EQ(&a.str(), &b.str());
+  EXPECT_TRUE(a == b);
+  EXPECT_FALSE(a == c);
+  EXPECT_TRUE(a != c);
+
+  // Ordering is by address, not that of the strings, but it is strict.
+  EXPECT_TRUE(a < c || c < a);
+  EXPECT_FALSE(a < b);
+
+  EXPECT_TRUE(InternedString().empty());
+  EXPECT_TRUE(InternedString() == interner.Intern(""));
+  EXPECT_FALSE(a.empty());
+}
+
+TEST(IwyuStringUtilTest, InternedStringFind) {
+  StringInterner interner;
+  EXPECT_FALSE(interner.Find("<never/interned.h>").has_value());
+
+  InternedString interned = interner.Intern("<interned.h>");
+  std::optional<InternedString> found = interner.Find("<interned.h>");
+  ASSERT_TRUE(found.has_value());
+  EXPECT_TRUE(*found == interned);
+
+  // Each interner has its own strings.
+  EXPECT_FALSE(StringInterner().Find("<interned.h>").has_value());
+}
+
+TEST(IwyuStringUtilTest, InternedStringDenseMap) {
+  StringInterner interner;
+  llvm::DenseMap<InternedString, int> map;
+  map[interner.Intern("a.h")] = 1;
+  map[interner.Intern("b.h")] = 2;
+  EXPECT_EQ(1, map.lookup(interner.Intern("a.h")));
+  EXPECT_EQ(2, map.lookup(interner.Intern("b.h")));
+  EXPECT_EQ(0, map.lookup(interner.Intern("c.h")));
+}
+
 }  // namespace
 }  // namespace include_what_you_use